@@ -0,0 +1,319 @@
+#include "analyzer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+// Instructions that end a basic block and where control goes after them
+static bool is_skip(uint16_t opcode) {
+  uint8_t T = opcode >> 12;
+  uint8_t NN = opcode & 0x00FF;
+  return T == 0x3 || T == 0x4 || T == 0x5 || T == 0x9 ||
+         (T == 0xE && (NN == 0x9E || NN == 0xA1));
+}
+
+static bool ends_block(uint16_t opcode) {
+  uint8_t T = opcode >> 12;
+  return opcode == 0x00EE || T == 0x1 || T == 0x2 || T == 0xB ||
+         is_skip(opcode);
+}
+
+std::string RomAnalysis::disassemble(uint16_t opcode) {
+  uint8_t T = opcode >> 12;
+  uint8_t X = (opcode & 0x0F00) >> 8;
+  uint8_t Y = (opcode & 0x00F0) >> 4;
+  uint8_t N = opcode & 0x000F;
+  uint8_t NN = opcode & 0x00FF;
+  uint16_t NNN = opcode & 0x0FFF;
+  static const char *const alu[16] = {
+      "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+      nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr};
+
+  char text[32];
+  switch (T) {
+  case 0x0:
+    if (opcode == 0x00E0)
+      return "CLS";
+    if (opcode == 0x00EE)
+      return "RET";
+    std::snprintf(text, sizeof(text), "SYS 0x%03X", NNN);
+    break;
+  case 0x1:
+    std::snprintf(text, sizeof(text), "JP 0x%03X", NNN);
+    break;
+  case 0x2:
+    std::snprintf(text, sizeof(text), "CALL 0x%03X", NNN);
+    break;
+  case 0x3:
+    std::snprintf(text, sizeof(text), "SE V%X, 0x%02X", X, NN);
+    break;
+  case 0x4:
+    std::snprintf(text, sizeof(text), "SNE V%X, 0x%02X", X, NN);
+    break;
+  case 0x5:
+    std::snprintf(text, sizeof(text), "SE V%X, V%X", X, Y);
+    break;
+  case 0x6:
+    std::snprintf(text, sizeof(text), "LD V%X, 0x%02X", X, NN);
+    break;
+  case 0x7:
+    std::snprintf(text, sizeof(text), "ADD V%X, 0x%02X", X, NN);
+    break;
+  case 0x8:
+    if (alu[N] == nullptr)
+      std::snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+    else if (N == 0x6 || N == 0xE)
+      std::snprintf(text, sizeof(text), "%s V%X", alu[N], X);
+    else
+      std::snprintf(text, sizeof(text), "%s V%X, V%X", alu[N], X, Y);
+    break;
+  case 0x9:
+    std::snprintf(text, sizeof(text), "SNE V%X, V%X", X, Y);
+    break;
+  case 0xA:
+    std::snprintf(text, sizeof(text), "LD I, 0x%03X", NNN);
+    break;
+  case 0xB:
+    std::snprintf(text, sizeof(text), "JP V0, 0x%03X", NNN);
+    break;
+  case 0xC:
+    std::snprintf(text, sizeof(text), "RND V%X, 0x%02X", X, NN);
+    break;
+  case 0xD:
+    std::snprintf(text, sizeof(text), "DRW V%X, V%X, %u", X, Y, N);
+    break;
+  case 0xE:
+    if (NN == 0x9E)
+      std::snprintf(text, sizeof(text), "SKP V%X", X);
+    else if (NN == 0xA1)
+      std::snprintf(text, sizeof(text), "SKNP V%X", X);
+    else
+      std::snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+    break;
+  default:
+    switch (NN) {
+    case 0x07:
+      std::snprintf(text, sizeof(text), "LD V%X, DT", X);
+      break;
+    case 0x0A:
+      std::snprintf(text, sizeof(text), "LD V%X, K", X);
+      break;
+    case 0x15:
+      std::snprintf(text, sizeof(text), "LD DT, V%X", X);
+      break;
+    case 0x18:
+      std::snprintf(text, sizeof(text), "LD ST, V%X", X);
+      break;
+    case 0x1E:
+      std::snprintf(text, sizeof(text), "ADD I, V%X", X);
+      break;
+    case 0x29:
+      std::snprintf(text, sizeof(text), "LD F, V%X", X);
+      break;
+    case 0x33:
+      std::snprintf(text, sizeof(text), "LD B, V%X", X);
+      break;
+    case 0x55:
+      std::snprintf(text, sizeof(text), "LD [I], V%X", X);
+      break;
+    case 0x65:
+      std::snprintf(text, sizeof(text), "LD V%X, [I]", X);
+      break;
+    default:
+      std::snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+      break;
+    }
+    break;
+  }
+  return text;
+}
+
+bool RomAnalysis::analyze(const uint8_t *data, size_t size) {
+  const size_t max_rom_size =
+      RomAnalysis::memory_size - RomAnalysis::program_start_address;
+  if (size > max_rom_size) {
+    std::cerr << "[ERROR] Rom is " << size << " bytes, the program area only "
+              << "holds " << max_rom_size << std::endl;
+    return false;
+  }
+
+  *this = RomAnalysis();
+  std::copy(data, data + size,
+            this->memory.begin() + RomAnalysis::program_start_address);
+  this->rom_size = size;
+
+  this->find_code();
+  this->build_blocks();
+  this->find_stores();
+  this->find_data();
+  return true;
+}
+
+uint16_t RomAnalysis::opcode(uint16_t address) const {
+  address &= RomAnalysis::memory_size - 1;
+  if (address >= RomAnalysis::memory_size - 1)
+    return this->memory[address] << 8;
+  return (this->memory[address] << 8) | this->memory[address + 1];
+}
+
+int RomAnalysis::block_at(uint16_t address) const {
+  auto it = std::lower_bound(
+      this->blocks.begin(), this->blocks.end(), address,
+      [](const Block &block, uint16_t a) { return block.start < a; });
+  if (it == this->blocks.end() || it->start != address)
+    return -1;
+  return static_cast<int>(it - this->blocks.begin());
+}
+
+void RomAnalysis::find_code() {
+  // Every address a block may start at, instructions are walked from each one
+  // until control leaves the straight-line run
+  std::vector<uint16_t> worklist{RomAnalysis::program_start_address};
+  this->address_flags[RomAnalysis::program_start_address] |= BLOCK_START;
+
+  auto add_leader = [&](uint16_t address, uint8_t flag) {
+    if (address >= RomAnalysis::memory_size - 1)
+      return;
+    this->address_flags[address] |= BLOCK_START | flag;
+    if (!(this->address_flags[address] & CODE))
+      worklist.push_back(address);
+  };
+
+  while (!worklist.empty()) {
+    uint16_t pc = worklist.back();
+    worklist.pop_back();
+
+    while (pc < RomAnalysis::memory_size - 1 &&
+           !(this->address_flags[pc] & CODE)) {
+      uint16_t opcode = this->opcode(pc);
+      this->address_flags[pc] |= CODE | CODE_BYTE;
+      this->address_flags[pc + 1] |= CODE_BYTE;
+      uint8_t T = opcode >> 12;
+      uint16_t NNN = opcode & 0x0FFF;
+
+      if (T == 0xA)
+        this->address_flags[NNN] |= I_TARGET;
+
+      if (!ends_block(opcode)) {
+        pc += 2;
+        continue;
+      }
+      if (T == 0x1) {
+        add_leader(NNN, 0);
+      } else if (T == 0x2) {
+        add_leader(NNN, CALL_TARGET);
+        add_leader(pc + 2, 0);
+      } else if (T == 0xB) {
+        this->indirect_jumps.push_back(pc);
+      } else if (is_skip(opcode)) {
+        add_leader(pc + 2, 0);
+        add_leader(pc + 4, 0);
+      }
+      break;
+    }
+  }
+  std::sort(this->indirect_jumps.begin(), this->indirect_jumps.end());
+}
+
+void RomAnalysis::build_blocks() {
+  for (unsigned int start = 0; start < RomAnalysis::memory_size; start++) {
+    if (!(this->address_flags[start] & BLOCK_START) ||
+        !(this->address_flags[start] & CODE))
+      continue;
+
+    Block block{static_cast<uint16_t>(start), 0, 0, Exit::END, {}};
+    unsigned int pc = start;
+    while (true) {
+      if (pc >= RomAnalysis::memory_size - 1) {
+        block.exit = Exit::END;
+        break;
+      }
+      uint16_t opcode = this->opcode(pc);
+      uint8_t T = opcode >> 12;
+      uint16_t NNN = opcode & 0x0FFF;
+      block.length++;
+      pc += 2;
+
+      if (opcode == 0x00EE) {
+        block.exit = Exit::RETURN;
+        break;
+      } else if (T == 0x1) {
+        block.exit = Exit::JUMP;
+        block.successors.push_back(NNN);
+        break;
+      } else if (T == 0x2) {
+        block.exit = Exit::CALL;
+        block.successors.push_back(NNN);
+        block.successors.push_back(pc);
+        break;
+      } else if (T == 0xB) {
+        block.exit = Exit::INDIRECT;
+        break;
+      } else if (is_skip(opcode)) {
+        block.exit = Exit::SKIP;
+        block.successors.push_back(pc);
+        block.successors.push_back(pc + 2);
+        break;
+      }
+      if (pc < RomAnalysis::memory_size &&
+          (this->address_flags[pc] & BLOCK_START)) {
+        block.exit = Exit::FALLTHROUGH;
+        block.successors.push_back(pc);
+        break;
+      }
+    }
+    block.end = pc;
+    this->blocks.push_back(block);
+  }
+}
+
+void RomAnalysis::find_stores() {
+  // I is only followed within a block, from an ANNN to the store
+  for (const Block &block : this->blocks) {
+    bool known = false;
+    uint16_t I = 0;
+    for (unsigned int pc = block.start; pc + 1 < block.end; pc += 2) {
+      uint16_t opcode = this->opcode(pc);
+      uint8_t T = opcode >> 12;
+      uint8_t X = (opcode & 0x0F00) >> 8;
+      uint8_t NN = opcode & 0x00FF;
+
+      if (T == 0xA) {
+        known = true;
+        I = opcode & 0x0FFF;
+      } else if (T == 0xF && (NN == 0x1E || NN == 0x29)) {
+        known = false;
+      } else if (T == 0xF && (NN == 0x33 || NN == 0x55)) {
+        if (!known) {
+          this->unresolved_stores.push_back(pc);
+          continue;
+        }
+        unsigned int count = NN == 0x33 ? 3 : X + 1;
+        bool into_code = false;
+        for (unsigned int i = 0; i < count; i++) {
+          uint16_t address = (I + i) & (RomAnalysis::memory_size - 1);
+          this->address_flags[address] |= STORE_TARGET;
+          into_code |= (this->address_flags[address] & CODE_BYTE) != 0;
+        }
+        if (into_code)
+          this->code_stores.push_back(pc);
+      }
+    }
+  }
+  std::sort(this->code_stores.begin(), this->code_stores.end());
+  std::sort(this->unresolved_stores.begin(), this->unresolved_stores.end());
+}
+
+void RomAnalysis::find_data() {
+  unsigned int end = RomAnalysis::program_start_address + this->rom_size;
+  for (unsigned int a = RomAnalysis::program_start_address; a < end;) {
+    if (this->address_flags[a] & CODE_BYTE) {
+      a++;
+      continue;
+    }
+    Region region{static_cast<uint16_t>(a), 0};
+    while (a < end && !(this->address_flags[a] & CODE_BYTE))
+      this->address_flags[a++] |= DATA;
+    region.end = a;
+    this->data.push_back(region);
+  }
+}
@@ -0,0 +1,114 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Static analysis of a rom as CHIP8::load_rom lays it out in memory. Code is
+// found by recursive traversal from the program start following jumps,
+// calls, return sites and both successors of every skip, then split into
+// basic blocks. Whatever the traversal does not reach is treated as data.
+class RomAnalysis {
+public:
+  static const unsigned int memory_size = 4096;
+  static const uint16_t program_start_address = 0x200;
+
+  // Per address flags
+  enum Flag : uint8_t {
+    // An instruction reached by the traversal starts here
+    CODE = 1 << 0,
+    // Byte belongs to a reached instruction
+    CODE_BYTE = 1 << 1,
+    BLOCK_START = 1 << 2,
+    CALL_TARGET = 1 << 3,
+    // Rom byte the traversal did not reach
+    DATA = 1 << 4,
+    // Loaded into I by an ANNN (usually sprite or BCD scratch data)
+    I_TARGET = 1 << 5,
+    // Written by an FX33 or FX55 whose I is known
+    STORE_TARGET = 1 << 6
+  };
+
+  // How control leaves a basic block
+  enum Exit : uint8_t {
+    // Runs into the next block's first instruction
+    FALLTHROUGH,
+    JUMP,     // 1NNN
+    CALL,     // 2NNN, successors are the callee and the return site
+    RETURN,   // 00EE, successors depend on the call stack
+    SKIP,     // 3XNN 4XNN 5XY0 9XY0 EX9E EXA1
+    INDIRECT, // BNNN, successors depend on V0
+    // Runs off the end of memory
+    END
+  };
+
+  struct Block {
+    uint16_t start;
+    uint16_t end;    // one past the last byte of the block
+    uint16_t length; // instructions in the block
+    Exit exit;
+    // Statically known successors
+    std::vector<uint16_t> successors;
+  };
+
+  struct Region {
+    uint16_t start;
+    uint16_t end; // one past the last byte
+  };
+
+  // Mnemonic in the notation of the comments in chip8.cpp, e.g. "LD V1, 0x2A"
+  static std::string disassemble(uint16_t opcode);
+
+  // Returns false if the rom does not fit the program area
+  bool analyze(const uint8_t *data, size_t size);
+
+  uint8_t flags(uint16_t address) const {
+    return this->address_flags[address & (memory_size - 1)];
+  }
+  uint8_t byte(uint16_t address) const {
+    return this->memory[address & (memory_size - 1)];
+  }
+  // Opcode of the two bytes at address in the loaded image
+  uint16_t opcode(uint16_t address) const;
+  // Index into get_blocks() of the block starting at address, -1 if none
+  int block_at(uint16_t address) const;
+
+  // Sorted by start address
+  const std::vector<Block> &get_blocks() const { return this->blocks; }
+  // Runs of unreached rom bytes
+  const std::vector<Region> &get_data() const { return this->data; }
+  // Addresses of BNNN instructions
+  const std::vector<uint16_t> &get_indirect_jumps() const {
+    return this->indirect_jumps;
+  }
+  // Addresses of FX33 and FX55 instructions that store into code
+  const std::vector<uint16_t> &get_code_stores() const {
+    return this->code_stores;
+  }
+  // Addresses of FX33 and FX55 instructions whose I is not known statically
+  // (I set in another block or by FX1E, FX29), these may modify code too
+  const std::vector<uint16_t> &get_unresolved_stores() const {
+    return this->unresolved_stores;
+  }
+  size_t get_rom_size() const { return this->rom_size; }
+
+private:
+  void find_code();
+  void build_blocks();
+  void find_stores();
+  void find_data();
+
+  std::array<uint8_t, memory_size> memory{};
+  std::array<uint8_t, memory_size> address_flags{};
+  size_t rom_size = 0;
+  std::vector<Block> blocks;
+  std::vector<Region> data;
+  std::vector<uint16_t> indirect_jumps;
+  std::vector<uint16_t> code_stores;
+  std::vector<uint16_t> unresolved_stores;
+};
+
+#endif
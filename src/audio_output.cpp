@@ -0,0 +1,54 @@
+#include "audio_output.hpp"
+#include <algorithm>
+#include <string>
+
+AudioOutput::~AudioOutput() { this->close(); }
+
+bool AudioOutput::open(ToneSynth *tone, unsigned int buffer_frames) {
+  this->close();
+  if (!SDL_WasInit(SDL_INIT_AUDIO))
+    return false;
+
+  // SDL takes the buffer size as a hint, the device may pick another
+  buffer_frames = std::max(1u, buffer_frames);
+  std::string frames = std::to_string(buffer_frames);
+  SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, frames.c_str());
+
+  this->tone = tone;
+  this->buffer.assign(buffer_frames, 0.0f);
+  SDL_AudioSpec spec;
+  spec.format = SDL_AUDIO_F32;
+  spec.channels = 1;
+  spec.freq = static_cast<int>(tone->get_sample_rate());
+  this->stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK,
+                                           &spec, &AudioOutput::feed, this);
+  if (this->stream == nullptr) {
+    SDL_LogError(0, "[ERROR] SDL_OpenAudioDeviceStream: %s\n", SDL_GetError());
+    return false;
+  }
+  // Devices opened with a stream start paused
+  SDL_ResumeAudioStreamDevice(this->stream);
+  return true;
+}
+
+void AudioOutput::close() {
+  // Also stops the device, no callback runs after this returns
+  if (this->stream != nullptr)
+    SDL_DestroyAudioStream(this->stream);
+  this->stream = nullptr;
+}
+
+void SDLCALL AudioOutput::feed(void *userdata, SDL_AudioStream *stream,
+                               int additional_amount, int) {
+  // Only what the device needs right now is rendered, queueing more would
+  // only add latency
+  AudioOutput *output = static_cast<AudioOutput *>(userdata);
+  size_t samples = std::max(additional_amount, 0) / sizeof(float);
+  while (samples > 0) {
+    size_t count = std::min(samples, output->buffer.size());
+    output->tone->render(output->buffer.data(), count);
+    SDL_PutAudioStreamData(stream, output->buffer.data(),
+                           static_cast<int>(count * sizeof(float)));
+    samples -= count;
+  }
+}
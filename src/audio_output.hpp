@@ -0,0 +1,35 @@
+#ifndef AUDIO_OUTPUT_H
+#define AUDIO_OUTPUT_H
+
+#include "tone.hpp"
+#include <SDL3/SDL.h>
+#include <vector>
+
+// Plays a ToneSynth on the default SDL playback device. SDL asks for
+// samples from its audio thread, they are rendered into a buffer allocated
+// when the device is opened, so that thread never locks or allocates and
+// the emulator never waits for it.
+class AudioOutput {
+public:
+  static const unsigned int default_buffer_frames = 256;
+
+  AudioOutput() = default;
+  ~AudioOutput();
+  AudioOutput(const AudioOutput &) = delete;
+  AudioOutput &operator=(const AudioOutput &) = delete;
+
+  // Start playback with a device buffer of buffer_frames samples (256 at
+  // 48kHz is 5.3ms of latency). Returns false if no device could be opened.
+  bool open(ToneSynth *tone, unsigned int buffer_frames);
+  void close();
+
+private:
+  static void SDLCALL feed(void *userdata, SDL_AudioStream *stream,
+                           int additional_amount, int total_amount);
+
+  ToneSynth *tone = nullptr;
+  SDL_AudioStream *stream = nullptr;
+  std::vector<float> buffer;
+};
+
+#endif
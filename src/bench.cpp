@@ -0,0 +1,407 @@
+#include "chip8.hpp"
+#include "display.hpp"
+#include "keyboard.hpp"
+#include "lanes.hpp"
+#include "rom_file.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define DISPLAY_WIDTH 64
+#define DISPLAY_HEIGHT 32
+
+// Set by CMake to the repository's roms/ directory
+#ifndef CHIP8_ROM_DIR
+#define CHIP8_ROM_DIR "roms"
+#endif
+
+struct BenchResult {
+  std::string group;
+  std::string name;
+  std::string engine;
+  // Instructions (or frames for the render group) per sample
+  uint64_t work = 0;
+  // Nanoseconds per unit of work for every sample, sorted
+  std::vector<double> samples{};
+};
+
+struct BenchConfig {
+  unsigned int samples = 15;
+  uint64_t micro_cycles = 200000;
+  uint64_t rom_cycles = 1000000;
+  std::string filter;
+  std::string rom_dir = CHIP8_ROM_DIR;
+};
+
+static const char *engine_name(Engine engine) {
+  switch (engine) {
+  case Engine::CACHED:
+    return "cached";
+  case Engine::JIT:
+    return "jit";
+  case Engine::THREADED:
+    return "threaded";
+  default:
+    return "interpreter";
+  }
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const std::vector<double> &sorted, double p) {
+  size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Time samples runs of body (one warm-up run first), each doing work units
+static void measure(BenchResult &result, const BenchConfig &config,
+                    uint64_t work, const std::function<void()> &body) {
+  result.work = work;
+  body();
+  for (unsigned int sample = 0; sample < config.samples; sample++) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+    result.samples.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count() / work);
+  }
+  std::sort(result.samples.begin(), result.samples.end());
+}
+
+// A program that sets up registers then loops over body forever
+struct MicroProgram {
+  std::string name;
+  std::vector<uint16_t> setup;
+  std::vector<uint16_t> body;
+  // Placed at 0x400, for CALL/RET
+  std::vector<uint16_t> subroutine{};
+};
+
+static std::vector<uint16_t> repeat(std::vector<uint16_t> ops, size_t count) {
+  std::vector<uint16_t> out;
+  while (out.size() < count)
+    out.insert(out.end(), ops.begin(), ops.end());
+  out.resize(count);
+  return out;
+}
+
+static std::vector<MicroProgram> micro_programs() {
+  // V0..VE = 1..15 so skips below are deterministic
+  std::vector<uint16_t> registers;
+  for (uint16_t x = 0; x < 0xF; x++)
+    registers.push_back(0x6000 | (x << 8) | (x + 1));
+
+  std::vector<MicroProgram> programs;
+  programs.push_back({"alu_8xyn", registers,
+                      repeat({0x8014, 0x8125, 0x8231, 0x8342, 0x8453, 0x8566,
+                              0x8677, 0x878E, 0x8890, 0x7901},
+                             60)});
+  // Mix of taken and not taken skips (a taken skip jumps over another skip)
+  programs.push_back({"skip", registers,
+                      repeat({0x3001, 0x3102, 0x4003, 0x4102, 0x5010, 0x5000,
+                              0x9010, 0x9000},
+                             60)});
+  programs.push_back({"call_ret", registers, repeat({0x2400}, 60), {0x00EE}});
+  std::vector<uint16_t> memory_setup = registers;
+  memory_setup.push_back(0xA600);
+  programs.push_back({"fx55_fx65", memory_setup,
+                      repeat({0xF755, 0xF765, 0xFE55, 0xFE65}, 60)});
+  // Sprite heights, unwrapped at (8, 4) and wrapping over both edges at
+  // (60, 28)
+  const uint8_t heights[] = {1, 4, 8, 15};
+  for (uint8_t n : heights) {
+    for (int wrap = 0; wrap < 2; wrap++) {
+      std::string name = "dxyn_h" + std::to_string(n) + (wrap ? "_wrap" : "");
+      std::vector<uint16_t> setup = {
+          static_cast<uint16_t>(wrap ? 0x603C : 0x6008),
+          static_cast<uint16_t>(wrap ? 0x611C : 0x6104), 0xA050};
+      programs.push_back({name, setup, repeat({uint16_t(0xD010 | n)}, 60)});
+    }
+  }
+  return programs;
+}
+
+static void bench_micro(const BenchConfig &config, Engine engine,
+                        std::vector<BenchResult> &results) {
+  for (const MicroProgram &program : micro_programs()) {
+    BenchResult result{"micro", program.name, engine_name(engine)};
+    if (result.name.find(config.filter) == std::string::npos)
+      continue;
+
+    std::vector<uint8_t> rom;
+    auto emit = [&rom](uint16_t op) {
+      rom.push_back(op >> 8);
+      rom.push_back(op & 0xFF);
+    };
+    for (uint16_t op : program.setup)
+      emit(op);
+    uint16_t loop = CHIP8::program_start_address + rom.size();
+    for (uint16_t op : program.body)
+      emit(op);
+    emit(0x1000 | loop);
+    rom.resize(0x400 - CHIP8::program_start_address, 0);
+    for (uint16_t op : program.subroutine)
+      emit(op);
+
+    Display display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    Keyboard keyboard;
+    CHIP8 c8(&display, &keyboard);
+    c8.set_engine(engine);
+    result.engine = engine_name(c8.get_engine());
+    c8.load_rom(rom.data(), rom.size());
+    c8.run(program.setup.size());
+
+    measure(result, config, config.micro_cycles,
+            [&] { c8.run(config.micro_cycles); });
+    results.push_back(result);
+  }
+}
+
+static std::vector<std::string> list_roms(const std::string &dir) {
+  std::vector<std::string> roms;
+  DIR *handle = opendir(dir.c_str());
+  if (handle == nullptr) {
+    std::cerr << "[ERROR] Failed to open rom directory " << dir << std::endl;
+    return roms;
+  }
+  while (dirent *entry = readdir(handle)) {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".ch8") == 0)
+      roms.push_back(name);
+  }
+  closedir(handle);
+  std::sort(roms.begin(), roms.end());
+  return roms;
+}
+
+static void bench_roms(const BenchConfig &config, Engine engine,
+                       std::vector<BenchResult> &results) {
+  for (const std::string &name : list_roms(config.rom_dir)) {
+    BenchResult result{"rom", name, engine_name(engine)};
+    if (result.name.find(config.filter) == std::string::npos)
+      continue;
+
+    std::string path = config.rom_dir + "/" + name;
+    Display display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    Keyboard keyboard;
+    CHIP8 c8(&display, &keyboard);
+    c8.set_engine(engine);
+    result.engine = engine_name(c8.get_engine());
+    if (!c8.load_rom(path.c_str()))
+      continue;
+    Scheduler scheduler(&c8);
+    // Skipped spin loops would count as instructions run for free
+    scheduler.set_idle_skip(false);
+
+    measure(result, config, config.rom_cycles,
+            [&] { scheduler.run_cycles(config.rom_cycles); });
+    results.push_back(result);
+  }
+}
+
+// Every rom on a full LaneEngine, each lane seeded differently. Work is the
+// instructions of all lanes together, so ns per instruction compares
+// directly with the scalar engines.
+static void bench_lanes(const BenchConfig &config,
+                        std::vector<BenchResult> &results) {
+  for (const std::string &name : list_roms(config.rom_dir)) {
+    BenchResult result{"rom", name, "lanes"};
+    if (result.name.find(config.filter) == std::string::npos)
+      continue;
+
+    std::string path = config.rom_dir + "/" + name;
+    RomFile rom;
+    if (!rom.open(path.c_str()))
+      continue;
+    auto lanes = std::make_unique<LaneEngine>();
+    if (!lanes->load_rom(rom.data(), rom.size()))
+      continue;
+    for (unsigned int lane = 0; lane < lanes->get_lanes(); lane++)
+      lanes->seed_random(lane, CHIP8::default_seed + lane);
+
+    // Timers tick where the Scheduler would put them
+    uint64_t per_lane = std::max<uint64_t>(
+        1, config.rom_cycles / lanes->get_lanes());
+    uint64_t cycles = 0;
+    uint64_t ticks = 0;
+    measure(result, config, per_lane * lanes->get_lanes(), [&] {
+      uint64_t end = cycles + per_lane;
+      while (cycles < end) {
+        uint64_t next_tick = (ticks + 1) * Scheduler::default_cpu_hz /
+                             Scheduler::timer_hz;
+        uint64_t target = std::min(end, next_tick);
+        lanes->step_all(target - cycles);
+        cycles = target;
+        if (cycles == next_tick) {
+          lanes->tick_timers();
+          ticks++;
+        }
+      }
+    });
+    results.push_back(result);
+  }
+}
+
+// The front end's per-frame conversion of the packed display to ARGB8888,
+// on a screen that changes every frame
+static void bench_render(const BenchConfig &config,
+                         std::vector<BenchResult> &results) {
+  BenchResult result{"render", "argb_convert", "-"};
+  if (result.name.find(config.filter) == std::string::npos)
+    return;
+
+  Display display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+  const uint8_t sprite[] = {0xF0, 0x90, 0xF0, 0x90, 0x90};
+  for (unsigned int i = 0; i < 64; i++)
+    display.draw_sprite(i * 7, i * 3, sprite, 5);
+  std::vector<uint32_t> pixels(DISPLAY_WIDTH * DISPLAY_HEIGHT);
+  const uint64_t frames = 2000;
+  uint32_t sink = 0;
+
+  measure(result, config, frames, [&] {
+    for (uint64_t frame = 0; frame < frames; frame++) {
+      display.toggle_pixel(frame % DISPLAY_WIDTH, 0);
+      const std::vector<uint64_t> &buffer = display.get_buffer();
+      unsigned int words_per_row = display.get_words_per_row();
+      for (unsigned int y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (unsigned int x = 0; x < DISPLAY_WIDTH; x++) {
+          uint64_t word = buffer[y * words_per_row + x / 64];
+          bool state = (word >> (63 - x % 64)) & 0b1;
+          pixels[y * DISPLAY_WIDTH + x] = state ? 0xFFFFFFFF : 0xFF000000;
+        }
+      }
+      sink += pixels[frame % pixels.size()];
+    }
+  });
+  if (sink == 1)
+    std::cerr << std::endl;
+  results.push_back(result);
+}
+
+static void print_text(const std::vector<BenchResult> &results) {
+  std::printf("%-7s %-16s %-12s %10s %10s %10s %10s %14s\n", "group", "name",
+              "engine", "min ns", "p50 ns", "p90 ns", "p99 ns", "per sec");
+  for (const BenchResult &r : results)
+    std::printf("%-7s %-16s %-12s %10.3f %10.3f %10.3f %10.3f %14.0f\n",
+                r.group.c_str(), r.name.c_str(), r.engine.c_str(),
+                r.samples.front(), percentile(r.samples, 0.5),
+                percentile(r.samples, 0.9), percentile(r.samples, 0.99),
+                1e9 / percentile(r.samples, 0.5));
+}
+
+static void print_csv(const std::vector<BenchResult> &results) {
+  std::printf("group,name,engine,work,samples,min_ns,p50_ns,p90_ns,p99_ns,"
+              "per_sec\n");
+  for (const BenchResult &r : results)
+    std::printf("%s,%s,%s,%llu,%zu,%.4f,%.4f,%.4f,%.4f,%.0f\n",
+                r.group.c_str(), r.name.c_str(), r.engine.c_str(),
+                (unsigned long long)r.work, r.samples.size(), r.samples.front(),
+                percentile(r.samples, 0.5), percentile(r.samples, 0.9),
+                percentile(r.samples, 0.99), 1e9 / percentile(r.samples, 0.5));
+}
+
+static void print_json(const std::vector<BenchResult> &results) {
+  std::printf("[\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &r = results[i];
+    std::printf("  {\"group\": \"%s\", \"name\": \"%s\", \"engine\": \"%s\", "
+                "\"work\": %llu, \"samples\": %zu, \"min_ns\": %.4f, "
+                "\"p50_ns\": %.4f, \"p90_ns\": %.4f, \"p99_ns\": %.4f, "
+                "\"per_sec\": %.0f}%s\n",
+                r.group.c_str(), r.name.c_str(), r.engine.c_str(),
+                (unsigned long long)r.work, r.samples.size(), r.samples.front(),
+                percentile(r.samples, 0.5), percentile(r.samples, 0.9),
+                percentile(r.samples, 0.99), 1e9 / percentile(r.samples, 0.5),
+                i + 1 < results.size() ? "," : "");
+  }
+  std::printf("]\n");
+}
+
+static void print_usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [--engine interpreter|cached|jit|threaded|lanes|all]"
+               " [--samples N] [--cycles N] [--rom-cycles N] [--roms DIR]"
+               " [--filter TEXT] [--format text|csv|json]"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig config;
+  std::vector<Engine> engines = {Engine::INTERPRETER, Engine::CACHED,
+                                 Engine::JIT, Engine::THREADED};
+  // LaneEngine rom runs, not one of the CHIP8 engines
+  bool lanes = true;
+  std::string format = "text";
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      i++;
+      if (std::strcmp(argv[i], "interpreter") == 0) {
+        engines = {Engine::INTERPRETER};
+        lanes = false;
+      } else if (std::strcmp(argv[i], "cached") == 0) {
+        engines = {Engine::CACHED};
+        lanes = false;
+      } else if (std::strcmp(argv[i], "jit") == 0) {
+        engines = {Engine::JIT};
+        lanes = false;
+      } else if (std::strcmp(argv[i], "threaded") == 0) {
+        engines = {Engine::THREADED};
+        lanes = false;
+      } else if (std::strcmp(argv[i], "lanes") == 0) {
+        engines.clear();
+      } else if (std::strcmp(argv[i], "all") != 0) {
+        std::cerr << "[ERROR] Unknown engine: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      config.samples = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      config.micro_cycles =
+          std::max(1ull, std::strtoull(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--rom-cycles") == 0 && i + 1 < argc) {
+      config.rom_cycles = std::max(1ull, std::strtoull(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--roms") == 0 && i + 1 < argc) {
+      config.rom_dir = argv[++i];
+    } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      config.filter = argv[++i];
+    } else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      format = argv[++i];
+      if (format != "text" && format != "csv" && format != "json") {
+        print_usage(argv[0]);
+        return 1;
+      }
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<BenchResult> results;
+  for (Engine engine : engines) {
+    bench_micro(config, engine, results);
+    bench_roms(config, engine, results);
+  }
+  if (lanes)
+    bench_lanes(config, results);
+  bench_render(config, results);
+
+  if (format == "json")
+    print_json(results);
+  else if (format == "csv")
+    print_csv(results);
+  else
+    print_text(results);
+
+  return 0;
+}
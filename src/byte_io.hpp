@@ -0,0 +1,28 @@
+#ifndef BYTE_IO_H
+#define BYTE_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Little endian integers of the binary file formats (input logs and the rom
+// library index)
+
+// Append the low bytes of value
+inline void put_uint(std::vector<uint8_t> &out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++)
+    out.push_back((value >> (8 * i)) & 0xFF);
+}
+
+// Read bytes at position and move past them, returns false if in ends first
+inline bool get_uint(const std::vector<uint8_t> &in, size_t &position,
+                     int bytes, uint64_t &value) {
+  if (position + bytes > in.size())
+    return false;
+  value = 0;
+  for (int i = 0; i < bytes; i++)
+    value |= static_cast<uint64_t>(in[position++]) << (8 * i);
+  return true;
+}
+
+#endif
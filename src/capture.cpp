@@ -0,0 +1,330 @@
+#include "capture.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// Pixel x of a packed row
+static bool lit(const uint64_t *row, unsigned int x) {
+  return (row[x / 64] >> (63 - x % 64)) & 0b1;
+}
+
+static void put_u16(std::vector<uint8_t> &out, uint16_t value) {
+  out.push_back(value & 0xFF);
+  out.push_back(value >> 8);
+}
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 0; shift < 32; shift += 8)
+    out.push_back((value >> shift) & 0xFF);
+}
+
+static void put_u32_be(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back((value >> shift) & 0xFF);
+}
+
+static uint32_t crc32(const uint8_t *data, size_t size) {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++)
+        c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      t[n] = c;
+    }
+    return t;
+  }();
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
+// Length, type, data and CRC of one PNG chunk, data is out[start..] on entry
+static void finish_png_chunk(std::vector<uint8_t> &out, size_t start,
+                             const char *type) {
+  size_t length = out.size() - start;
+  std::vector<uint8_t> header;
+  put_u32_be(header, static_cast<uint32_t>(length));
+  header.insert(header.end(), type, type + 4);
+  out.insert(out.begin() + start, header.begin(), header.end());
+  uint32_t crc = crc32(&out[start + 4], length + 4);
+  put_u32_be(out, crc);
+}
+
+CaptureFormat FrameCapture::format_for(const char *path) {
+  size_t length = std::strlen(path);
+  if (length >= 4 && std::strcmp(path + length - 4, ".y4m") == 0)
+    return CaptureFormat::Y4M;
+  if (length >= 4 && std::strcmp(path + length - 4, ".png") == 0)
+    return CaptureFormat::PNG;
+  return CaptureFormat::RAW;
+}
+
+FrameCapture::~FrameCapture() { this->stop(); }
+
+bool FrameCapture::start(const char *path, CaptureFormat format,
+                         Display &display, unsigned int scale) {
+  if (this->thread.joinable() || this->file != nullptr ||
+      this->playlist != nullptr) {
+    std::cerr << "[ERROR] Capture already started" << std::endl;
+    return false;
+  }
+
+  this->format = format;
+  this->path = path;
+  this->width = display.get_width();
+  this->height = display.get_height();
+  this->words_per_row = display.get_words_per_row();
+  this->scale = std::max(1u, scale);
+
+  std::vector<uint8_t> header;
+  if (format == CaptureFormat::PNG) {
+    // out.png becomes out_000000.png, out_000001.png, ... and out.ffconcat
+    this->png_prefix = this->path.substr(0, this->path.size() - 4);
+    std::string name = this->png_prefix + ".ffconcat";
+    this->playlist = std::fopen(name.c_str(), "w");
+    if (this->playlist == nullptr) {
+      std::cerr << "[ERROR] Failed to open " << name << std::endl;
+      return false;
+    }
+    std::fprintf(this->playlist, "ffconcat version 1.0\n");
+  } else {
+    this->file = std::fopen(path, "wb");
+    if (this->file == nullptr) {
+      std::cerr << "[ERROR] Failed to open " << path << std::endl;
+      return false;
+    }
+    if (format == CaptureFormat::RAW) {
+      put_u32(header, FrameCapture::raw_magic);
+      put_u32(header, FrameCapture::raw_version);
+      put_u16(header, this->width);
+      put_u16(header, this->height);
+      std::fwrite(header.data(), 1, header.size(), this->file);
+    } else {
+      std::fprintf(this->file, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C420jpeg\n",
+                   this->width * this->scale, this->height * this->scale);
+    }
+  }
+
+  size_t words = this->height * this->words_per_row;
+  this->pool.assign(FrameCapture::pool_size * words, 0);
+  for (uint32_t i = 0; i < FrameCapture::pool_size; i++)
+    this->free_buffers.push(i);
+  this->stopping = false;
+  this->thread = std::thread(&FrameCapture::write, this);
+  return true;
+}
+
+void FrameCapture::push(Display &display) {
+  if (!this->thread.joinable())
+    return;
+  this->frames++;
+
+  const std::vector<uint64_t> &pixels = display.get_buffer();
+  size_t words = this->height * this->words_per_row;
+  if (this->pending) {
+    // Unchanged frames only extend the current record
+    const uint64_t *buffer = &this->pool[this->current.buffer * words];
+    if ((display.get_generation() == this->generation ||
+         std::equal(buffer, buffer + words, pixels.begin())) &&
+        this->current.frames < UINT32_MAX) {
+      this->generation = display.get_generation();
+      this->current.frames++;
+      return;
+    }
+    this->submit();
+  }
+
+  // Only waits when every buffer of the pool is queued for the writer
+  uint32_t index;
+  if (!this->free_buffers.pop(index)) {
+    this->stalls++;
+    while (!this->free_buffers.pop(index))
+      std::this_thread::yield();
+  }
+  std::copy(pixels.begin(), pixels.begin() + words,
+            &this->pool[index * words]);
+  this->current = {index, 1};
+  this->generation = display.get_generation();
+  this->pending = true;
+}
+
+void FrameCapture::submit() {
+  // There are only pool_size buffers, so the queue always has room
+  this->records.push(this->current);
+  this->pending = false;
+}
+
+bool FrameCapture::stop() {
+  if (!this->thread.joinable())
+    return !this->failed;
+  if (this->pending)
+    this->submit();
+  this->stopping.store(true, std::memory_order_release);
+  this->thread.join();
+
+  if (this->file != nullptr && std::fclose(this->file) != 0)
+    this->failed = true;
+  if (this->playlist != nullptr && std::fclose(this->playlist) != 0)
+    this->failed = true;
+  this->file = nullptr;
+  this->playlist = nullptr;
+  if (this->failed)
+    std::cerr << "[ERROR] Failed to write capture " << this->path
+              << std::endl;
+  return !this->failed;
+}
+
+uint64_t FrameCapture::get_frames() { return this->frames; }
+uint64_t FrameCapture::get_records() { return this->record_count; }
+uint64_t FrameCapture::get_stalls() { return this->stalls; }
+
+void FrameCapture::write() {
+  Record record;
+  while (true) {
+    // Records submitted before stopping was set are visible once it is, so
+    // finding the queue empty after seeing the flag means all were written
+    bool stopping = this->stopping.load(std::memory_order_acquire);
+    if (!this->records.pop(record)) {
+      if (stopping)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    if (!this->failed && !this->write_record(record))
+      this->failed = true;
+    this->record_count++;
+    this->free_buffers.push(record.buffer);
+  }
+}
+
+bool FrameCapture::write_record(const Record &record) {
+  const uint64_t *pixels =
+      &this->pool[record.buffer * this->height * this->words_per_row];
+  switch (this->format) {
+  case CaptureFormat::Y4M:
+    return this->write_y4m(pixels, record.frames);
+  case CaptureFormat::PNG:
+    return this->write_png(pixels, record.frames);
+  default:
+    return this->write_raw(pixels, record.frames);
+  }
+}
+
+bool FrameCapture::write_raw(const uint64_t *pixels, uint32_t frames) {
+  std::vector<uint8_t> &out = this->encoded;
+  out.clear();
+  put_u32(out, frames);
+  unsigned int row_bytes = (this->width + 7) / 8;
+  for (unsigned int y = 0; y < this->height; y++) {
+    const uint64_t *row = pixels + y * this->words_per_row;
+    for (unsigned int b = 0; b < row_bytes; b++)
+      out.push_back((row[b / 8] >> (56 - 8 * (b % 8))) & 0xFF);
+  }
+  return std::fwrite(out.data(), 1, out.size(), this->file) == out.size();
+}
+
+bool FrameCapture::write_y4m(const uint64_t *pixels, uint32_t frames) {
+  // Luma upscaled by repeating pixels, chroma is neutral
+  unsigned int w = this->width * this->scale;
+  unsigned int h = this->height * this->scale;
+  size_t chroma = static_cast<size_t>((w + 1) / 2) * ((h + 1) / 2);
+  std::vector<uint8_t> &out = this->encoded;
+  out.clear();
+  for (unsigned int y = 0; y < h; y++) {
+    const uint64_t *row = pixels + (y / this->scale) * this->words_per_row;
+    for (unsigned int x = 0; x < w; x++)
+      out.push_back(lit(row, x / this->scale) ? 255 : 0);
+  }
+  out.insert(out.end(), 2 * chroma, 128);
+
+  // Y4M has no durations, so the frame is repeated
+  for (uint32_t f = 0; f < frames; f++)
+    if (std::fputs("FRAME\n", this->file) < 0 ||
+        std::fwrite(out.data(), 1, out.size(), this->file) != out.size())
+      return false;
+  return true;
+}
+
+bool FrameCapture::write_png(const uint64_t *pixels, uint32_t frames) {
+  unsigned int w = this->width * this->scale;
+  unsigned int h = this->height * this->scale;
+
+  // Filter byte 0 then 1 bit pixels, most significant bit first, 1 is white
+  std::vector<uint8_t> scanlines;
+  size_t row_bytes = (w + 7) / 8;
+  scanlines.reserve(h * (row_bytes + 1));
+  for (unsigned int y = 0; y < h; y++) {
+    const uint64_t *row = pixels + (y / this->scale) * this->words_per_row;
+    scanlines.push_back(0);
+    for (size_t b = 0; b < row_bytes; b++) {
+      uint8_t byte = 0;
+      for (unsigned int bit = 0; bit < 8; bit++) {
+        unsigned int x = b * 8 + bit;
+        if (x < w && lit(row, x / this->scale))
+          byte |= 0x80 >> bit;
+      }
+      scanlines.push_back(byte);
+    }
+  }
+
+  std::vector<uint8_t> &out = this->encoded;
+  out.clear();
+  const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  out.insert(out.end(), signature, signature + 8);
+
+  size_t start = out.size();
+  put_u32_be(out, w);
+  put_u32_be(out, h);
+  // Bit depth 1, grayscale, deflate, no filtering method, no interlace
+  out.insert(out.end(), {1, 0, 0, 0, 0});
+  finish_png_chunk(out, start, "IHDR");
+
+  // zlib stream of stored deflate blocks, the images are small enough that
+  // compressing them is not worth the writer's time
+  start = out.size();
+  out.insert(out.end(), {0x78, 0x01});
+  size_t offset = 0;
+  do {
+    size_t length = std::min<size_t>(scanlines.size() - offset, 0xFFFF);
+    bool last = offset + length == scanlines.size();
+    out.push_back(last ? 1 : 0);
+    put_u16(out, static_cast<uint16_t>(length));
+    put_u16(out, static_cast<uint16_t>(~length));
+    out.insert(out.end(), scanlines.begin() + offset,
+               scanlines.begin() + offset + length);
+    offset += length;
+  } while (offset < scanlines.size());
+  uint32_t a = 1, b = 0;
+  for (uint8_t byte : scanlines) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  put_u32_be(out, (b << 16) | a);
+  finish_png_chunk(out, start, "IDAT");
+
+  start = out.size();
+  finish_png_chunk(out, start, "IEND");
+
+  char number[16];
+  std::snprintf(number, sizeof(number), "_%06llu.png",
+                (unsigned long long)this->record_count);
+  std::string name = this->png_prefix + number;
+  FILE *image = std::fopen(name.c_str(), "wb");
+  if (image == nullptr) {
+    std::cerr << "[ERROR] Failed to open " << name << std::endl;
+    return false;
+  }
+  bool written = std::fwrite(out.data(), 1, out.size(), image) == out.size();
+  written &= std::fclose(image) == 0;
+
+  // The playlist lists images by name relative to itself
+  size_t slash = name.find_last_of("/\\");
+  std::string base = slash == std::string::npos ? name : name.substr(slash + 1);
+  std::fprintf(this->playlist, "file '%s'\nduration %.6f\n", base.c_str(),
+               frames / 60.0);
+  return written;
+}
@@ -0,0 +1,108 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "display.hpp"
+#include "spsc_queue.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Output formats of FrameCapture
+enum CaptureFormat {
+  // 1 bit per pixel: "C8FC" magic, u32 version, u16 width, u16 height (little
+  // endian), then per record a u32 frame count followed by the rows, each
+  // width / 8 bytes with the leftmost pixel in the most significant bit
+  RAW,
+  // YUV4MPEG2 video at 60 frames per second, upscaled by the capture scale
+  // (unchanged frames are written once per frame they were shown)
+  Y4M,
+  // 1 bit grayscale PNG per record, upscaled by the capture scale, plus an
+  // ffconcat playlist holding each image's duration
+  PNG
+};
+
+// Streams emulated frames to a file from a background writer thread.
+// Frames are copied into buffers from a fixed pool and handed to the writer
+// through a lock-free queue, so push() only waits when the writer is a whole
+// pool behind. Consecutive identical frames become one record with a frame
+// count.
+class FrameCapture {
+public:
+  // Records in flight between push() and the writer
+  static const size_t pool_size = 1024;
+  static const uint32_t raw_magic = 0x43463843; // "C8FC"
+  static const uint32_t raw_version = 1;
+
+  FrameCapture() = default;
+  ~FrameCapture();
+  FrameCapture(const FrameCapture &) = delete;
+  FrameCapture &operator=(const FrameCapture &) = delete;
+
+  // Picks the format from the extension of path: .y4m, .png (written as
+  // <name>_000000.png ... and <name>.ffconcat) or anything else for RAW.
+  static CaptureFormat format_for(const char *path);
+
+  // Open the output and start the writer for frames of this display's size,
+  // returns false if the output could not be created. scale is ignored by
+  // RAW. A capture can only be started once.
+  bool start(const char *path, CaptureFormat format, Display &display,
+             unsigned int scale = 1);
+  // Record the display as one emulated frame
+  void push(Display &display);
+  // Flush the last record, wait for the writer and close the output. Returns
+  // false if any write failed.
+  bool stop();
+
+  // Frames pushed, records written and pushes that had to wait for the writer
+  uint64_t get_frames();
+  uint64_t get_records();
+  uint64_t get_stalls();
+
+private:
+  struct Record {
+    uint32_t buffer;
+    uint32_t frames;
+  };
+
+  void write();
+  void submit();
+  bool write_record(const Record &record);
+  bool write_raw(const uint64_t *pixels, uint32_t frames);
+  bool write_y4m(const uint64_t *pixels, uint32_t frames);
+  bool write_png(const uint64_t *pixels, uint32_t frames);
+
+  CaptureFormat format = CaptureFormat::RAW;
+  std::string path;
+  FILE *file = nullptr;
+  // PNG playlist, the images go to their own files named after it
+  FILE *playlist = nullptr;
+  std::string png_prefix;
+  unsigned int width = 0;
+  unsigned int height = 0;
+  unsigned int words_per_row = 0;
+  unsigned int scale = 1;
+
+  // pool_size buffers of height * words_per_row words, back to back
+  std::vector<uint64_t> pool;
+  SpscQueue<uint32_t, pool_size> free_buffers;
+  SpscQueue<Record, pool_size> records;
+  // Scratch space of the writer thread for one encoded frame
+  std::vector<uint8_t> encoded;
+
+  // Frame being repeated, not submitted until it changes or capture stops
+  bool pending = false;
+  Record current{};
+  uint64_t generation = 0;
+
+  std::thread thread;
+  std::atomic<bool> stopping{false};
+  std::atomic<bool> failed{false};
+  uint64_t frames = 0;
+  uint64_t record_count = 0;
+  uint64_t stalls = 0;
+};
+
+#endif
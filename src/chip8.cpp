@@ -1,9 +1,31 @@
 #include "chip8.hpp"
+#include "analyzer.hpp"
 #include "display.hpp"
 #include "keyboard.hpp"
-#include <fstream>
+#include "random.hpp"
+#include "rom_file.hpp"
+#include <algorithm>
 #include <iostream>
 
+const std::array<uint8_t, CHIP8::fontset_size> CHIP8::fontset{
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
 CHIP8::CHIP8(Display *display, Keyboard *keyboard) {
   // Plug in peripherals
   this->display = display;
@@ -16,60 +38,305 @@ CHIP8::CHIP8(Display *display, Keyboard *keyboard) {
   this->I = 0x0;
   this->DT = 0x0;
   this->ST = 0x0;
+  this->seed_random(CHIP8::default_seed);
+  this->set_quirks(QUIRKS_DEFAULT);
 
   // Load fontset
-  std::array<uint8_t, CHIP8::fontset_size> font{
-      0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-      0x20, 0x60, 0x20, 0x20, 0x70, // 1
-      0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-      0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-      0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-      0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-      0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-      0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-      0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-      0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-      0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-      0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-      0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-      0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-      0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-      0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-  };
-
-  // Apply above font
   for (int i = 0; i < CHIP8::fontset_size; i++)
-    this->memory[CHIP8::fontset_start_address + i] = font[i];
+    this->memory[CHIP8::fontset_start_address + i] = CHIP8::fontset[i];
+
+  this->invalidate_cache();
 }
 
-void CHIP8::load_rom(const char *filename) {
-  // Open the rom
-  std::streampos rom_size;
-  std::ifstream rom(filename, std::ios::binary);
+CHIP8::~CHIP8() = default;
 
-  if (rom.is_open()) {
-    // Get rom size
-    rom.seekg(0, std::ios::end);
-    rom_size = rom.tellg();
-    rom.seekg(0, std::ios::beg);
+bool CHIP8::load_rom(const char *filename) {
+  // Mapped and copied straight into memory, the size is checked before
+  // anything is read
+  RomFile rom;
+  if (!rom.open(filename))
+    return false;
+  return this->load_rom(rom.data(), rom.size());
+}
 
-    // Reserve space for the rom data
-    auto *rom_data = new uint8_t[rom_size];
-    rom.read((char *)rom_data, rom_size);
-    rom.close();
+bool CHIP8::load_rom(const uint8_t *data, size_t size) {
+  if (size > CHIP8::max_rom_size) {
+    std::cerr << "[ERROR] Rom is " << size << " bytes, the program area only "
+              << "holds " << CHIP8::max_rom_size << std::endl;
+    return false;
+  }
 
-    for (int i = 0; i < rom_size; i++)
-      this->memory[CHIP8::program_start_address + i] = rom_data[i];
+  std::copy_n(data, size, &this->memory[CHIP8::program_start_address]);
+  this->invalidate_cache();
 
-    delete[] rom_data;
-  } else {
-    std::cerr << "[ERROR] Failed to load rom" << std::endl;
-  }
+  return true;
 }
 
 void CHIP8::step() {
+  this->sound_edge = false;
+  switch (this->engine) {
+  // Translating a block for a single instruction does not pay off
+  case Engine::JIT:
+  case Engine::CACHED:
+    this->execute_cached();
+    break;
+  case Engine::THREADED:
+    (this->*this->threaded)(1);
+    break;
+  default:
+    (this->*this->interpreter)(1);
+    break;
+  }
+}
+
+uint64_t CHIP8::run(uint64_t cycles) {
+  this->sound_edge = false;
+  // Keep the engine choice out of the per-instruction loop
+  switch (this->engine) {
+  case Engine::JIT:
+    return this->jit->run(*this, cycles);
+  case Engine::CACHED:
+    for (uint64_t i = 0; i < cycles; i++) {
+      this->execute_cached();
+      if (this->sound_edge)
+        return i + 1;
+    }
+    return cycles;
+  case Engine::THREADED:
+    return (this->*this->threaded)(cycles);
+  default:
+    return (this->*this->interpreter)(cycles);
+  }
+}
+
+uint64_t CHIP8::run_skipping_idle(uint64_t cycles) {
+#ifdef CHIP8_PROFILE
+  // Skipped instructions would be missing from the counters
+  return this->run(cycles);
+#endif
+  uint64_t remaining = cycles;
+  while (remaining > 0) {
+    if (this->idle_countdown > 0) {
+      uint64_t batch = std::min(remaining, this->idle_countdown);
+      uint64_t ran = this->run(batch);
+      remaining -= ran;
+      this->idle_countdown -= ran;
+      if (ran < batch)
+        return cycles - remaining;
+      continue;
+    }
+
+    // Step one instruction at a time until the starting state comes back.
+    // With no stores, display changes or outside input in between, the
+    // machine then repeats the same iteration until the call ends.
+    const IdleState start = this->idle_state();
+    uint64_t probe = std::min<uint64_t>(remaining, CHIP8::max_idle_period);
+    uint64_t period = 0;
+    for (uint64_t i = 1; i <= probe; i++) {
+      this->step();
+      if (this->sound_edge)
+        return cycles - remaining + i;
+      if (this->PC == start.PC && this->is_idle_state(start)) {
+        period = i;
+        break;
+      }
+    }
+
+    if (period == 0) {
+      remaining -= probe;
+      this->idle_countdown = this->idle_backoff;
+      this->idle_backoff =
+          std::min<uint64_t>(this->idle_backoff * 2, CHIP8::max_idle_backoff);
+      continue;
+    }
+    // Skip every whole iteration that fits and run the partial one left over.
+    // A loop that came back to the same ST made no sound edge.
+    this->run((remaining - period) % period);
+    this->idle_backoff = CHIP8::min_idle_backoff;
+    return cycles;
+  }
+  return cycles;
+}
+
+void CHIP8::set_stop_on_sound_edge(bool stop) {
+  this->stop_on_sound_edge = stop;
+}
+
+CHIP8::IdleState CHIP8::idle_state() {
+  return {this->V,  this->stack, this->opcode,   this->PC,
+          this->I,  this->SP,    this->DT,       this->ST,
+          this->rng_state, this->stores, this->display->get_generation()};
+}
+
+bool CHIP8::is_idle_state(const IdleState &state) {
+  return this->V == state.V && this->opcode == state.opcode &&
+         this->PC == state.PC && this->I == state.I &&
+         this->SP == state.SP && this->DT == state.DT &&
+         this->ST == state.ST && this->rng_state == state.rng_state &&
+         this->stores == state.stores &&
+         this->display->get_generation() == state.display_generation &&
+         this->stack == state.stack;
+}
+
+void CHIP8::set_engine(Engine engine) {
+#ifdef CHIP8_PROFILE
+  // Translated code has no profiling hooks
+  if (engine == Engine::JIT) {
+    std::cerr << "[ERROR] JIT unavailable in profiling builds, using cached "
+                 "interpreter"
+              << std::endl;
+    engine = Engine::CACHED;
+  }
+#endif
+  if (engine == Engine::JIT) {
+    if (!this->jit)
+      this->jit = std::make_unique<Recompiler>();
+    if (!this->jit->is_available()) {
+      std::cerr << "[ERROR] JIT unavailable, using cached interpreter"
+                << std::endl;
+      engine = Engine::CACHED;
+    }
+  }
+
+  this->engine = engine;
+}
+Engine CHIP8::get_engine() { return this->engine; }
+
+void CHIP8::set_quirks(QuirkProfile profile) {
+  this->quirk_profile = profile;
+  switch (profile) {
+  case QUIRKS_VIP:
+    this->interpreter = &CHIP8::run_interpreter<QUIRKS_VIP>;
+    this->threaded = &CHIP8::run_threaded<QUIRKS_VIP>;
+    break;
+  case QUIRKS_CHIP48:
+    this->interpreter = &CHIP8::run_interpreter<QUIRKS_CHIP48>;
+    this->threaded = &CHIP8::run_threaded<QUIRKS_CHIP48>;
+    break;
+  case QUIRKS_SCHIP:
+    this->interpreter = &CHIP8::run_interpreter<QUIRKS_SCHIP>;
+    this->threaded = &CHIP8::run_threaded<QUIRKS_SCHIP>;
+    break;
+  default:
+    this->interpreter = &CHIP8::run_interpreter<QUIRKS_DEFAULT>;
+    this->threaded = &CHIP8::run_threaded<QUIRKS_DEFAULT>;
+    break;
+  }
+  this->invalidate_cache();
+}
+QuirkProfile CHIP8::get_quirks() { return this->quirk_profile; }
+
+void CHIP8::write_memory(uint16_t address, uint8_t value) {
+  address &= CHIP8::memory_size - 1;
+  this->memory[address] = value;
+  this->stores++;
+
+  // Instructions are two bytes long, so both the instruction starting at this
+  // address and the one starting right before it are now stale
+  this->decode_cache[address].handler = ops::decode_and_execute;
+  this->decode_cache[(address - 1) & (CHIP8::memory_size - 1)].handler =
+      ops::decode_and_execute;
+  if (this->jit)
+    this->jit->invalidate(address);
+}
+
+void CHIP8::invalidate_cache() {
+  for (Instruction &ins : this->decode_cache)
+    ins.handler = ops::decode_and_execute;
+  if (this->jit)
+    this->jit->flush();
+}
+
+void CHIP8::prewarm(const RomAnalysis &analysis) {
+  // Only the cached engines have anything to warm up
+  if (this->engine != Engine::CACHED && this->engine != Engine::JIT)
+    return;
+  for (unsigned int a = 0; a < CHIP8::memory_size - 1; a++) {
+    if (!(analysis.flags(a) & RomAnalysis::CODE))
+      continue;
+    uint16_t opcode = (this->memory[a] << 8) | this->memory[a + 1];
+    this->decode_cache[a] = ops::decode(opcode, this->quirk_profile);
+  }
+  if (this->engine == Engine::JIT)
+    for (const RomAnalysis::Block &block : analysis.get_blocks())
+      this->jit->prewarm(*this, block.start);
+}
+
+void CHIP8::execute_cached() {
+  // Execute one instruction from the decode cache
+  if (this->PC < 0xFFF) {
+    PROFILE_HOOK(uint16_t profile_pc = this->PC;)
+    const Instruction &ins = this->decode_cache[this->PC];
+    this->opcode = ins.opcode;
+    this->PC += 2;
+    ins.handler(*this, ins);
+    PROFILE_HOOK(this->profile.executed(profile_pc, this->opcode, this->PC);)
+  }
+}
+
+void CHIP8::set_sound_timer(uint8_t value) {
+  if (this->stop_on_sound_edge && (this->ST != 0) != (value != 0))
+    this->sound_edge = true;
+  this->ST = value;
+}
+
+bool CHIP8::waiting_for_key() {
+  return this->PC < memory_size - 1 &&
+         (this->memory[this->PC] & 0xF0) == 0xF0 &&
+         this->memory[this->PC + 1] == 0x0A &&
+         this->keyboard->get_keys() == 0;
+}
+
+void CHIP8::tick_timers() {
+  if (this->DT > 0)
+    this->DT--;
+  if (this->ST > 0)
+    this->ST--;
+  PROFILE_HOOK(this->profile.frame();)
+}
+
+void CHIP8::seed_random(uint64_t seed) {
+  this->rng_state = random_state_from_seed(seed);
+}
+
+uint8_t CHIP8::random_byte() { return random_next_byte(this->rng_state); }
+
+void CHIP8::draw_sprite(uint8_t X, uint8_t Y, uint8_t N, bool wrap) {
+  // Display n-byte sprite starting at memory location I at (VX, VY),
+  // set VF = collision
+  // Reset VF flag
+  this->V[0xF] = 0;
+
+  // N represents how many bytes make up the sprite, reads past the end of
+  // memory wrap around to the start
+  uint8_t sprite[16];
+  for (int n = 0; n < N; n++)
+    sprite[n] = this->memory[(this->I + n) & (CHIP8::memory_size - 1)];
+
+  // Each sprite row is XORed onto the screen, turning off a lit pixel is a
+  // collision
+  bool collision =
+      this->display->draw_sprite(this->V[X], this->V[Y], sprite, N, wrap);
+  if (collision)
+    this->V[0xF] = 1;
+  PROFILE_HOOK(this->profile.sprite(N, collision);)
+}
+
+template <QuirkProfile P> uint64_t CHIP8::run_interpreter(uint64_t cycles) {
+  for (uint64_t i = 0; i < cycles; i++) {
+    this->interpret<P>();
+    if (this->sound_edge)
+      return i + 1;
+  }
+  return cycles;
+}
+
+template <QuirkProfile P> void CHIP8::interpret() {
+  constexpr Quirks quirks = quirks_for(P);
+
   // Execute one instruction
   if (this->PC < 0xFFF) {
+    PROFILE_HOOK(uint16_t profile_pc = this->PC;)
     // Fetch the current instruction.
     // Instructions are two bytes long and stored most-significant-byte first.
     // The first byte of each instruction should be located at an even address.
@@ -165,16 +432,22 @@ void CHIP8::step() {
         // Set VX = VX OR VY
         // Bitwise or operation
         this->V[X] |= this->V[Y];
+        if constexpr (quirks.reset_vf)
+          this->V[0xF] = 0;
         break;
       case 0x2: // 8XY2 - AND VX, VY
         // Set VX = VX AND VY
         // Bitwise and operation
         this->V[X] &= this->V[Y];
+        if constexpr (quirks.reset_vf)
+          this->V[0xF] = 0;
         break;
       case 0x3: // 8XY3 - XOR VX, VY
         // Set VX = VX XOR VY
         // Bitwise exclusive or operation
         this->V[X] ^= this->V[Y];
+        if constexpr (quirks.reset_vf)
+          this->V[0xF] = 0;
         break;
       case 0x4: // 8XY4 - ADD VX, VY
         // Set VX = VX + VY, set VF = carry
@@ -195,9 +468,12 @@ void CHIP8::step() {
         // Set VX = VX SHR 1
         // If least-significant bit of VX is 1, VF = 1 else VF = 0, then VX >>
         // 1
+        // With the shift_vy quirk VY is shifted into VX instead
+        if constexpr (quirks.shift_vy)
+          this->V[X] = this->V[Y];
         // Flag if least-significant bit will be lost
         flag = this->V[X] & 0b1;
-        // Shift VY right once and save in VX
+        // Shift VX right once
         this->V[X] >>= 1;
         this->V[0xF] = flag;
         break;
@@ -214,6 +490,8 @@ void CHIP8::step() {
         // Set VX = VX SHL 1
         // If most-significant bit of VX is 1, VF = 1 else VF = 0, then VX <<
         // 1
+        if constexpr (quirks.shift_vy)
+          this->V[X] = this->V[Y];
         // Flag if most-significant bit will be lost
         flag = (this->V[X] >> 7) & 0b1;
         // Shift VX left once
@@ -234,63 +512,28 @@ void CHIP8::step() {
       this->I = NNN;
       break;
     case 0xB: // BNNN - JP V0, addr
-      // Jump to location NNN + V0
-      this->PC = NNN + this->V[0x0];
+      // Jump to location NNN + V0, or XNN + VX with the jump_vx quirk
+      this->PC = NNN + this->V[quirks.jump_vx ? X : 0x0];
       break;
     case 0xC: // CXNN - RND VX, byte
       // Set VX = random byte AND NN
-      this->V[X] = (rand() % 256) & NN;
+      this->V[X] = this->random_byte() & NN;
       break;
     case 0xD: // DXYN - DRW VX, VY, nibble
-      // TODO: Go over this implementation again to verify correctness
       // Display n-byte sprite starting at memory location I at (VX, VY),
       // set VF = collision
-      // Reset VF flag
-      this->V[0xF] = 0;
-
-      // Pixel coordinate
-      int x, y;
-      // Go through each byte of the sprite
-      // N represents how many bytes make up the sprite
-      for (int n = 0; n < N; n++) {
-        // Wrap bottom to top
-        y = (this->V[Y] + n) % this->display->get_height();
-        // Grab a byte from the sprite
-        uint8_t sprite_byte = this->memory[this->I + n];
-        // Go through each bit of sprite byte
-        for (int b = 0; b < 8; b++) {
-          x = (this->V[X] + b) % this->display->get_width();
-          bool sprite_bit = (sprite_byte >> (7 - b)) & 0b1;
-          // When screen and sprite pixels are on, set collision flag
-          // because xor causes erasures when both values are on
-          bool pixel = this->display->get_pixel(x, y);
-          if (pixel && sprite_bit)
-            this->V[0xF] = 1;
-          // XOR bit onto screen
-          // pixel | sprite | XOR
-          // --------------------
-          //   0   |   0    |  0
-          //   0   |   1    |  1
-          //   1   |   0    |  1
-          //   1   |   1    |  0
-          // XOR result only changes pixel when sprite is 1
-          if (sprite_bit)
-            this->display->toggle_pixel(x, y);
-        }
-      }
+      this->draw_sprite(X, Y, N, !quirks.clip_sprites);
       break;
     case 0xE:
       switch (NN) {
       case (0x9E): // EX9E - SKP
         // Skip next instruction if key with the value of VX is pressed
-        pressed_key = this->keyboard->get_pressed_key();
-        if (pressed_key != Key::NONE && pressed_key == this->V[X])
+        if (this->keyboard->is_pressed(this->V[X]))
           this->PC += 2;
         break;
       case (0xA1): // EXA1 - SKNP VX
         // Skip next instruction if key with the value of VX is not pressed
-        pressed_key = this->keyboard->get_pressed_key();
-        if (pressed_key != Key::NONE && pressed_key != this->V[X])
+        if (!this->keyboard->is_pressed(this->V[X]))
           this->PC += 2;
         break;
       default:
@@ -304,13 +547,13 @@ void CHIP8::step() {
         this->V[X] = this->DT;
         break;
       case 0x0A: // FX0A - LD VX, K
-        // Wait for key press then save value to VX
-        while (true) {
-          pressed_key = this->keyboard->get_pressed_key();
-          if (pressed_key != Key::NONE)
-            break;
-        }
-        this->V[X] = pressed_key;
+        // Save the lowest held key to VX, without one stay on this
+        // instruction so it runs again next cycle (see waiting_for_key())
+        pressed_key = this->keyboard->get_pressed_key();
+        if (pressed_key != Key::NONE)
+          this->V[X] = pressed_key;
+        else
+          this->PC -= 2;
         break;
       case 0x15: // FX15 - LD DT, VX
         // FX15 - LD DT, VX
@@ -319,7 +562,7 @@ void CHIP8::step() {
         break;
       case 0x18: // FX18 - LD ST, VX
         // Set sound timer to VX
-        this->ST = this->V[X];
+        this->set_sound_timer(this->V[X]);
         break;
       case 0x1E: // FX1E - ADD I, VX
         // Set I to I + VX
@@ -332,19 +575,28 @@ void CHIP8::step() {
         break;
       case 0x33: // FX33 - LD B, VX
         // Store BCD representation of VX in memory locations I, I+1, and I+2
-        this->memory[this->I] = this->V[X] / 100;            // Hundreds digit
-        this->memory[this->I + 1] = (this->V[X] % 100) / 10; // Tens digit
-        this->memory[this->I + 2] = (this->V[X] % 10);       // Ones digit
+        this->write_memory(this->I, this->V[X] / 100);            // Hundreds
+        this->write_memory(this->I + 1, (this->V[X] % 100) / 10); // Tens
+        this->write_memory(this->I + 2, this->V[X] % 10);         // Ones
         break;
       case 0x55: // FX55 - LD [I], VX
         // Store registers V0 through VX in memory starting at location I
         for (int x = 0; x <= X; x++)
-          this->memory[this->I + x] = this->V[x];
+          this->write_memory(this->I + x, this->V[x]);
+        // Some interpreters leave I after the last register (or on it)
+        if constexpr (quirks.memory_index == ADVANCE_I_BY_X)
+          this->I += X;
+        else if constexpr (quirks.memory_index == ADVANCE_I_PAST_X)
+          this->I += X + 1;
         break;
       case 0x65: // FX65 - LD VX, [I]
         // Read registers V0 through VX from memory starting at location I
         for (int x = 0; x <= X; x++)
           this->V[x] = this->memory[this->I + x];
+        if constexpr (quirks.memory_index == ADVANCE_I_BY_X)
+          this->I += X;
+        else if constexpr (quirks.memory_index == ADVANCE_I_PAST_X)
+          this->I += X + 1;
         break;
       default:
         break;
@@ -353,5 +605,6 @@ void CHIP8::step() {
     default:
       break;
     }
+    PROFILE_HOOK(this->profile.executed(profile_pc, this->opcode, this->PC);)
   }
 }
@@ -3,24 +3,110 @@
 
 #include "display.hpp"
 #include "keyboard.hpp"
+#include "ops.hpp"
+#include "profile.hpp"
+#include "quirks.hpp"
+#include "recompiler.hpp"
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+
+class RomAnalysis;
+
+// How step() and run() execute instructions
+enum Engine {
+  // Fetch, decode and dispatch every instruction through nested switches
+  INTERPRETER,
+  // Decode each address once and dispatch through the cached handler
+  CACHED,
+  // Translate basic blocks to native code (x86-64 only, falls back to CACHED)
+  JIT,
+  // Dispatch every opcode through a compile-time handler table, each handler
+  // jumping straight to the next one (computed goto where supported)
+  THREADED
+};
 
 class CHIP8 {
 public:
   static const unsigned int fontset_size = 80;
   static const uint16_t fontset_start_address = 0x50;
   static const uint16_t program_start_address = 0x200;
+  static const unsigned int memory_size = 4096;
+  static const unsigned int max_rom_size = memory_size - program_start_address;
+  static const uint64_t default_seed = 0xC8;
+  // Hexadecimal digit sprites, 5 bytes each
+  static const std::array<uint8_t, fontset_size> fontset;
 
   CHIP8(Display *display, Keyboard *keyboard);
-  void load_rom(const char *filename);
+  ~CHIP8();
+  // Returns false if the file is missing, empty or does not fit the program
+  // area
+  bool load_rom(const char *filename);
+  // Copy an in-memory rom image into the program area, returns false if it
+  // does not fit
+  bool load_rom(const uint8_t *data, size_t size);
   void step();
+  // Execute up to the given number of instructions, returns how many ran.
+  // That is all of them unless stop_on_sound_edge is set and an FX18 turned
+  // the sound on or off, which ends the run right after it.
+  uint64_t run(uint64_t cycles);
+  // Same result as run(cycles), but once the machine returns to exactly the
+  // state it was in a few instructions earlier (a spin loop polling DT or a
+  // key, or a jump to itself) the remaining whole iterations are skipped.
+  // Timers and keys must not change during the call, which holds between the
+  // Scheduler's timer ticks and replayed key changes. Returns how many
+  // instructions ran or were skipped, ending early like run().
+  uint64_t run_skipping_idle(uint64_t cycles);
+  // End run() and run_skipping_idle() after an FX18 that starts or stops the
+  // sound, so the caller can time the edge to the instruction
+  void set_stop_on_sound_edge(bool stop);
+
+  // Selecting JIT on a host without JIT support selects CACHED instead
+  void set_engine(Engine engine);
+  Engine get_engine();
+  // Switch every engine to another quirk profile (drops cached decodes and
+  // translations made for the previous one)
+  void set_quirks(QuirkProfile profile);
+  QuirkProfile get_quirks();
+
+  // Store a byte in memory and drop any cached decode or translated block
+  // that covers it.
+  // All instruction stores go through here so cached code stays exact for
+  // self-modifying roms.
+  void write_memory(uint16_t address, uint8_t value);
+  // Drop every cached decode and translated block (call after modifying
+  // memory directly)
+  void invalidate_cache();
+  // Decode every instruction the analysis found and, on the JIT engine,
+  // translate its basic blocks ahead of time. Reads the loaded memory, so an
+  // analysis of a different image only wastes work.
+  void prewarm(const RomAnalysis &analysis);
+
+  // Count the delay and sound timers down by one, called at 60Hz
+  void tick_timers();
+  // FX18 - every engine sets ST through here
+  void set_sound_timer(uint8_t value);
+
+  // True while the next instruction is FX0A and no key is held. FX0A without
+  // a key leaves PC on itself, so until input arrives every cycle would only
+  // repeat it and callers may skip running instead.
+  bool waiting_for_key();
+
+  // Restart this instance's random sequence (used by CXNN)
+  void seed_random(uint64_t seed);
+  uint8_t random_byte();
+
+  // DXYN - draw N sprite rows from I at (VX, VY), set VF = collision. Rows
+  // running past the right and bottom edges wrap around, or are clipped when
+  // wrap is false.
+  void draw_sprite(uint8_t X, uint8_t Y, uint8_t N, bool wrap = true);
 
   // Periferals
   Display *display;
   Keyboard *keyboard;
   // System memory (4kbs)
-  std::array<uint8_t, 4096> memory{};
+  std::array<uint8_t, memory_size> memory{};
   // Miscellaneous Registers
   std::array<uint8_t, 16> V{};
   // Stack (for returning from subroutines)
@@ -37,6 +123,69 @@ public:
   // Special timers
   uint8_t DT; // Delay
   uint8_t ST; // Sound
+  // Random generator state, private to each instance so runs are
+  // reproducible and instances can run on different threads
+  uint64_t rng_state;
+
+#ifdef CHIP8_PROFILE
+  // Execution counters, only in builds configured with CHIP8_PROFILE
+  Profile profile;
+#endif
+
+private:
+  // Longest loop, in instructions, that run_skipping_idle looks for
+  static const unsigned int max_idle_period = 32;
+  // Bounds of the instructions run_skipping_idle executes normally before
+  // looking for a loop again, doubled after every miss
+  static const unsigned int min_idle_backoff = 16;
+  static const unsigned int max_idle_backoff = 1024;
+
+  // Everything the next instructions depend on besides memory and the
+  // display, which are covered by counters of their changes
+  struct IdleState {
+    std::array<uint8_t, 16> V;
+    std::array<uint16_t, 16> stack;
+    uint16_t opcode, PC, I;
+    uint8_t SP, DT, ST;
+    uint64_t rng_state;
+    uint64_t stores;
+    uint64_t display_generation;
+  };
+  IdleState idle_state();
+  bool is_idle_state(const IdleState &state);
+
+  // One instruction through the reference switch, and a run of them, with
+  // the quirks of profile P compiled in
+  template <QuirkProfile P> void interpret();
+  // the quirks of profile P compiled in. Runs return how many instructions
+  // ran, like run().
+  template <QuirkProfile P> uint64_t run_interpreter(uint64_t cycles);
+  // The THREADED engine, in threaded.cpp
+  template <QuirkProfile P> uint64_t run_threaded(uint64_t cycles);
+  void execute_cached();
+
+  Engine engine = Engine::INTERPRETER;
+  QuirkProfile quirk_profile = QUIRKS_DEFAULT;
+  // run_interpreter and run_threaded instantiated for quirk_profile
+  uint64_t (CHIP8::*interpreter)(uint64_t cycles);
+  uint64_t (CHIP8::*threaded)(uint64_t cycles);
+  // Decoded instruction for every address, entries that have not been decoded
+  // yet (or were invalidated by a store) point at ops::decode_and_execute
+  std::array<Instruction, memory_size> decode_cache;
+  // Created the first time the JIT engine is selected
+  std::unique_ptr<Recompiler> jit;
+  // Calls to write_memory, whatever the value
+  uint64_t stores = 0;
+  // Instructions left to run before run_skipping_idle looks for a loop
+  uint64_t idle_countdown = 0;
+  uint64_t idle_backoff = min_idle_backoff;
+  bool stop_on_sound_edge = false;
+  // Set by set_sound_timer() when the run has to end after the current
+  // instruction, cleared when the next run starts
+  bool sound_edge = false;
+
+  friend void ops::decode_and_execute(CHIP8 &c8, const Instruction &ins);
+  friend class Recompiler;
 };
 
 #endif
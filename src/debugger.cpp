@@ -0,0 +1,83 @@
+#include "debugger.hpp"
+
+void Debugger::toggle(Kind kind, uint16_t address) {
+  address &= CHIP8::memory_size - 1;
+  uint64_t bit = 1ull << (address % 64);
+  uint64_t &word = this->bits[kind][address / 64];
+  word ^= bit;
+  if (word & bit)
+    this->points++;
+  else
+    this->points--;
+}
+
+bool Debugger::is_set(Kind kind, uint16_t address) const {
+  address &= CHIP8::memory_size - 1;
+  return (this->bits[kind][address / 64] >> (address % 64)) & 1;
+}
+
+void Debugger::clear() {
+  for (auto &bitmap : this->bits)
+    bitmap.fill(0);
+  this->points = 0;
+  this->stepping_over = false;
+}
+
+void Debugger::step_over(const CHIP8 &c8) {
+  this->stepping_over = true;
+  this->skip_check = true;
+  this->return_address = (c8.PC + 2) & (CHIP8::memory_size - 1);
+  // A call returns with the stack pointer it started with
+  this->return_SP = c8.SP;
+}
+
+void Debugger::resume() {
+  // Unarmed nothing is checked, and the skip must not linger until later
+  this->skip_check = this->armed();
+}
+
+bool Debugger::watched(Kind kind, uint16_t address,
+                       unsigned int length) const {
+  for (unsigned int i = 0; i < length; i++)
+    if (this->is_set(kind, address + i))
+      return true;
+  return false;
+}
+
+Debugger::Stop Debugger::check(const CHIP8 &c8) {
+  if (this->skip_check) {
+    this->skip_check = false;
+    return Stop::NONE;
+  }
+  if (c8.PC >= CHIP8::memory_size - 1)
+    return Stop::NONE;
+
+  Stop stop = Stop::NONE;
+  uint16_t opcode = (c8.memory[c8.PC] << 8) | c8.memory[c8.PC + 1];
+  uint8_t X = (opcode & 0x0F00) >> 8;
+  uint8_t N = opcode & 0x000F;
+  uint8_t NN = opcode & 0x00FF;
+  if (this->stepping_over && c8.PC == this->return_address &&
+      c8.SP == this->return_SP)
+    stop = Stop::STEP_OVER_DONE;
+  else if (this->is_set(Kind::BREAKPOINT, c8.PC))
+    stop = Stop::BREAKPOINT_HIT;
+  else if ((opcode & 0xF000) == 0xD000 &&
+           this->watched(Kind::READ_WATCHPOINT, c8.I, N))
+    stop = Stop::READ_HIT;
+  else if ((opcode & 0xF0FF) == 0xF065 &&
+           this->watched(Kind::READ_WATCHPOINT, c8.I, X + 1))
+    stop = Stop::READ_HIT;
+  else if ((opcode & 0xF000) == 0xF000 && NN == 0x33 &&
+           this->watched(Kind::WRITE_WATCHPOINT, c8.I, 3))
+    stop = Stop::WRITE_HIT;
+  else if ((opcode & 0xF000) == 0xF000 && NN == 0x55 &&
+           this->watched(Kind::WRITE_WATCHPOINT, c8.I, X + 1))
+    stop = Stop::WRITE_HIT;
+
+  // Any stop ends a step over, it would be surprising to stop on its return
+  // much later
+  if (stop != Stop::NONE)
+    this->stepping_over = false;
+  return stop;
+}
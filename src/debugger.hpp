@@ -0,0 +1,57 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "chip8.hpp"
+#include <array>
+#include <cstdint>
+
+// PC breakpoints and memory watchpoints, each a bitmap with one bit per byte
+// of the 4KB address space. The Scheduler only consults it while something
+// is armed: then batches run one instruction at a time and each instruction
+// is checked before it executes. With nothing armed every engine runs
+// exactly as without a Debugger.
+class Debugger {
+public:
+  // What a bitmap stops on
+  enum Kind {
+    // The instruction at this address is about to run
+    BREAKPOINT,
+    // An instruction is about to read (DXYN, FX65) or write (FX33, FX55)
+    // this byte through I
+    READ_WATCHPOINT,
+    WRITE_WATCHPOINT,
+    KIND_COUNT
+  };
+  // Why execution stopped
+  enum Stop { NONE, BREAKPOINT_HIT, READ_HIT, WRITE_HIT, STEP_OVER_DONE };
+
+  void toggle(Kind kind, uint16_t address);
+  bool is_set(Kind kind, uint16_t address) const;
+  void clear();
+
+  // Run the call (2NNN) at c8.PC and stop when it returns to the next
+  // instruction at the same stack depth
+  void step_over(const CHIP8 &c8);
+  // Let the instruction at the current PC run without being checked once,
+  // so continuing from a stop does not stop on the same instruction again
+  void resume();
+
+  // Whether any breakpoint, watchpoint or step over is set
+  bool armed() const { return this->points > 0 || this->stepping_over; }
+  // Check the instruction at c8.PC before it runs
+  Stop check(const CHIP8 &c8);
+
+private:
+  // Whether any byte of address..address+length-1 (wrapping) is watched
+  bool watched(Kind kind, uint16_t address, unsigned int length) const;
+
+  std::array<std::array<uint64_t, CHIP8::memory_size / 64>, KIND_COUNT> bits{};
+  // Bits set across all bitmaps
+  unsigned int points = 0;
+  bool skip_check = false;
+  bool stepping_over = false;
+  uint16_t return_address = 0;
+  uint8_t return_SP = 0;
+};
+
+#endif
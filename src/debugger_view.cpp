@@ -0,0 +1,188 @@
+#include "debugger_view.hpp"
+#include "analyzer.hpp"
+#include "imgui.h"
+#include <cstdio>
+#include <string>
+
+static const ImU32 breakpoint_color = IM_COL32(160, 32, 32, 255);
+static const ImU32 pc_color = IM_COL32(48, 96, 160, 255);
+static const ImU32 read_color = IM_COL32(32, 128, 64, 255);
+static const ImU32 write_color = IM_COL32(160, 96, 32, 255);
+
+// Message carrying an address or frame number
+static EmulatorInput message(EmulatorInput::Type type, uint64_t value) {
+  EmulatorInput input;
+  input.type = type;
+  input.value = value;
+  return input;
+}
+
+static const char *stop_name(Debugger::Stop stop) {
+  switch (stop) {
+  case Debugger::BREAKPOINT_HIT:
+    return "breakpoint";
+  case Debugger::READ_HIT:
+    return "read watchpoint";
+  case Debugger::WRITE_HIT:
+    return "write watchpoint";
+  case Debugger::STEP_OVER_DONE:
+    return "step over";
+  default:
+    return nullptr;
+  }
+}
+
+void DebuggerView::draw(const EmulatorFrame &frame,
+                        EmulatorThread &emulator) {
+  this->draw_controls(frame, emulator);
+  if (ImGui::TreeNode("Disassembly")) {
+    this->draw_disassembly(frame, emulator);
+    ImGui::TreePop();
+  }
+  if (ImGui::TreeNode("Memory")) {
+    this->draw_memory(frame, emulator);
+    ImGui::TreePop();
+  }
+}
+
+void DebuggerView::draw_controls(const EmulatorFrame &frame,
+                                 EmulatorThread &emulator) {
+  if (frame.paused) {
+    if (ImGui::Button("Continue"))
+      emulator.send({EmulatorInput::CONTINUE});
+  } else if (ImGui::Button("Pause")) {
+    emulator.send({EmulatorInput::PAUSE});
+  }
+  ImGui::SameLine();
+  ImGui::BeginDisabled(!frame.paused);
+  if (ImGui::Button("Step"))
+    emulator.send({EmulatorInput::STEP});
+  ImGui::SameLine();
+  if (ImGui::Button("Step over"))
+    emulator.send({EmulatorInput::STEP_OVER});
+  ImGui::EndDisabled();
+
+  ImGui::SetNextItemWidth(120);
+  ImGui::InputInt("##frame", &this->target_frame);
+  ImGui::SameLine();
+  if (ImGui::Button("Run to frame") && this->target_frame > 0)
+    emulator.send(message(EmulatorInput::RUN_TO_FRAME, this->target_frame));
+
+  const char *stop = stop_name(frame.stop);
+  if (frame.paused && stop != nullptr)
+    ImGui::Text("Stopped by %s at 0x%03X", stop, frame.PC);
+  else if (frame.paused)
+    ImGui::Text("Paused at 0x%03X", frame.PC);
+  else
+    ImGui::Text("Running");
+}
+
+void DebuggerView::draw_disassembly(const EmulatorFrame &frame,
+                                    EmulatorThread &emulator) {
+  ImGui::Checkbox("Follow PC", &this->follow_pc);
+  const ImGuiTableFlags flags = ImGuiTableFlags_Borders |
+                                ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
+  if (!ImGui::BeginTable("Disassembly", 3, flags, ImVec2(0, 240)))
+    return;
+  ImGui::TableSetupScrollFreeze(0, 1);
+  ImGui::TableSetupColumn("Address");
+  ImGui::TableSetupColumn("Opcode");
+  ImGui::TableSetupColumn("Instruction");
+  ImGui::TableHeadersRow();
+
+  // Rows are two bytes apart starting on PC's parity, so the instructions
+  // around PC always line up
+  unsigned int base = frame.PC & 1;
+  int rows = (CHIP8::memory_size - base) / 2;
+  int pc_row = frame.PC / 2;
+  float row_height = ImGui::GetTextLineHeightWithSpacing();
+  if (this->follow_pc && frame.PC != this->followed_pc) {
+    ImGui::SetScrollY(pc_row * row_height - 120);
+    this->followed_pc = frame.PC;
+  }
+
+  ImGuiListClipper clipper;
+  clipper.Begin(rows, row_height);
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+      uint16_t address = base + row * 2;
+      uint16_t opcode = frame.memory[address] << 8;
+      if (address + 1u < CHIP8::memory_size)
+        opcode |= frame.memory[address + 1];
+
+      ImGui::TableNextRow();
+      if (frame.debugger.is_set(Debugger::BREAKPOINT, address))
+        ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg1, breakpoint_color);
+      else if (address == frame.PC)
+        ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg1, pc_color);
+      ImGui::TableNextColumn();
+      char label[16];
+      std::snprintf(label, sizeof(label), "%s0x%03X",
+                    address == frame.PC ? "> " : "  ", address);
+      // The whole row is one selectable, clicking it toggles the breakpoint
+      if (ImGui::Selectable(label, false,
+                            ImGuiSelectableFlags_SpanAllColumns))
+        emulator.send(message(EmulatorInput::TOGGLE_BREAKPOINT, address));
+      ImGui::TableNextColumn();
+      ImGui::Text("%04X", opcode);
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(RomAnalysis::disassemble(opcode).c_str());
+    }
+  }
+  ImGui::EndTable();
+}
+
+void DebuggerView::draw_memory(const EmulatorFrame &frame,
+                               EmulatorThread &emulator) {
+  const Debugger &debugger = frame.debugger;
+  bool read = debugger.is_set(Debugger::READ_WATCHPOINT, this->selected);
+  bool write = debugger.is_set(Debugger::WRITE_WATCHPOINT, this->selected);
+  ImGui::Text("0x%03X = 0x%02X", this->selected, frame.memory[this->selected]);
+  ImGui::SameLine();
+  if (ImGui::Checkbox("Watch reads", &read))
+    emulator.send(
+        message(EmulatorInput::TOGGLE_READ_WATCHPOINT, this->selected));
+  ImGui::SameLine();
+  if (ImGui::Checkbox("Watch writes", &write))
+    emulator.send(
+        message(EmulatorInput::TOGGLE_WRITE_WATCHPOINT, this->selected));
+
+  const unsigned int columns = 16;
+  const ImGuiTableFlags flags = ImGuiTableFlags_Borders |
+                                ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
+  if (!ImGui::BeginTable("Memory", columns + 1, flags, ImVec2(0, 240)))
+    return;
+  ImGui::TableSetupScrollFreeze(0, 1);
+  ImGui::TableSetupColumn("Address");
+  for (unsigned int column = 0; column < columns; column++) {
+    char name[4];
+    std::snprintf(name, sizeof(name), "%X", column);
+    ImGui::TableSetupColumn(name);
+  }
+  ImGui::TableHeadersRow();
+
+  ImGuiListClipper clipper;
+  clipper.Begin(CHIP8::memory_size / columns);
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("0x%03X", row * columns);
+      for (unsigned int column = 0; column < columns; column++) {
+        uint16_t address = row * columns + column;
+        ImGui::TableNextColumn();
+        // Watched bytes are tinted, reads over writes
+        if (debugger.is_set(Debugger::READ_WATCHPOINT, address))
+          ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, read_color);
+        else if (debugger.is_set(Debugger::WRITE_WATCHPOINT, address))
+          ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, write_color);
+        char label[16];
+        std::snprintf(label, sizeof(label), "%02X##%03X",
+                      frame.memory[address], address);
+        if (ImGui::Selectable(label, address == this->selected))
+          this->selected = address;
+      }
+    }
+  }
+  ImGui::EndTable();
+}
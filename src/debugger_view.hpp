@@ -0,0 +1,30 @@
+#ifndef DEBUGGER_VIEW_H
+#define DEBUGGER_VIEW_H
+
+#include "emulator_thread.hpp"
+#include <cstdint>
+
+// Debugger controls (pause, step, step over, run to frame) and live views of
+// the published frame's memory: a disassembly where clicking a line toggles
+// its breakpoint and a hex dump where the selected byte's watchpoints can be
+// toggled. Both go through ImGuiListClipper, so only rows on screen are
+// formatted and the views cost nothing while collapsed.
+class DebuggerView {
+public:
+  // Draw into the current ImGui window, commands go to emulator
+  void draw(const EmulatorFrame &frame, EmulatorThread &emulator);
+
+private:
+  void draw_controls(const EmulatorFrame &frame, EmulatorThread &emulator);
+  void draw_disassembly(const EmulatorFrame &frame, EmulatorThread &emulator);
+  void draw_memory(const EmulatorFrame &frame, EmulatorThread &emulator);
+
+  int target_frame = 0;
+  // Keep the disassembly scrolled to PC whenever it moves
+  bool follow_pc = true;
+  uint16_t followed_pc = 0xFFFF;
+  // Byte picked in the hex dump
+  uint16_t selected = CHIP8::program_start_address;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "analyzer.hpp"
+#include "rom_file.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static const char *const exit_names[] = {
+    "fallthrough", "jump", "call", "return", "skip", "indirect", "end"};
+
+static void print_usage(const char *program) {
+  std::cerr << "Usage: " << program << " <rom> [--dot]" << std::endl;
+}
+
+static void print_block(const RomAnalysis &analysis,
+                        const RomAnalysis::Block &block) {
+  std::printf("\n; block 0x%03X-0x%03X, %u instructions, %s", block.start,
+              block.end, block.length, exit_names[block.exit]);
+  for (uint16_t successor : block.successors)
+    std::printf(" 0x%03X", successor);
+  if (analysis.flags(block.start) & RomAnalysis::CALL_TARGET)
+    std::printf(", subroutine");
+  std::printf("\n");
+
+  for (unsigned int pc = block.start; pc + 1 < block.end; pc += 2) {
+    uint16_t opcode = analysis.opcode(pc);
+    std::printf("0x%03X  %04X  %s", pc, opcode,
+                RomAnalysis::disassemble(opcode).c_str());
+    if (analysis.flags(pc) & RomAnalysis::STORE_TARGET)
+      std::printf("  ; modified by a store");
+    std::printf("\n");
+  }
+}
+
+static void print_data(const RomAnalysis &analysis,
+                       const RomAnalysis::Region &region) {
+  std::printf("\n; data 0x%03X-0x%03X\n", region.start, region.end);
+  for (unsigned int a = region.start; a < region.end; a += 8) {
+    std::printf("0x%03X  .db", a);
+    for (unsigned int i = a; i < a + 8 && i < region.end; i++)
+      std::printf(" 0x%02X", analysis.byte(i));
+    std::printf("\n");
+  }
+}
+
+// Control-flow graph in Graphviz format, indirect jumps and returns get no
+// edges
+static void print_dot(const RomAnalysis &analysis) {
+  std::printf("digraph cfg {\n  node [shape=box fontname=monospace];\n");
+  for (const RomAnalysis::Block &block : analysis.get_blocks()) {
+    std::printf("  b%03X [label=\"0x%03X-0x%03X\\n%s\"];\n", block.start,
+                block.start, block.end, exit_names[block.exit]);
+    for (uint16_t successor : block.successors)
+      if (analysis.block_at(successor) >= 0)
+        std::printf("  b%03X -> b%03X;\n", block.start, successor);
+  }
+  std::printf("}\n");
+}
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr;
+  bool dot = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--dot") == 0) {
+      dot = true;
+    } else if (argv[i][0] != '-' && rom == nullptr) {
+      rom = argv[i];
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (rom == nullptr) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  RomFile file;
+  if (!file.open(rom))
+    return 1;
+
+  RomAnalysis analysis;
+  if (!analysis.analyze(file.data(), file.size()))
+    return 1;
+
+  if (dot) {
+    print_dot(analysis);
+    return 0;
+  }
+
+  // Blocks and data regions interleaved by address
+  const std::vector<RomAnalysis::Block> &blocks = analysis.get_blocks();
+  const std::vector<RomAnalysis::Region> &regions = analysis.get_data();
+  size_t b = 0;
+  size_t r = 0;
+  while (b < blocks.size() || r < regions.size()) {
+    if (r == regions.size() ||
+        (b < blocks.size() && blocks[b].start < regions[r].start))
+      print_block(analysis, blocks[b++]);
+    else
+      print_data(analysis, regions[r++]);
+  }
+
+  size_t code_bytes = 0;
+  for (const RomAnalysis::Region &region : regions)
+    code_bytes += region.end - region.start;
+  code_bytes = analysis.get_rom_size() - code_bytes;
+  std::printf("\n; %zu bytes, %zu code, %zu blocks, %zu data regions\n",
+              analysis.get_rom_size(), code_bytes, blocks.size(),
+              regions.size());
+  for (uint16_t pc : analysis.get_indirect_jumps())
+    std::printf("; indirect jump at 0x%03X\n", pc);
+  for (uint16_t pc : analysis.get_code_stores())
+    std::printf("; store into code at 0x%03X\n", pc);
+  for (uint16_t pc : analysis.get_unresolved_stores())
+    std::printf("; store with unknown I at 0x%03X\n", pc);
+
+  return 0;
+}
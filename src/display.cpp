@@ -6,35 +6,121 @@
 Display::Display(unsigned int width, unsigned int height) {
   this->width = width;
   this->height = height;
-  this->buffer.resize(width * height);
+  this->words_per_row = (width + 63) / 64;
+  this->buffer.resize(this->words_per_row * height);
   this->clear_buffer();
 }
 
-const std::vector<bool> &Display::get_buffer() { return this->buffer; }
+const std::vector<uint64_t> &Display::get_buffer() { return this->buffer; }
+
+void Display::load_buffer(const uint64_t *words, size_t count) {
+  count = std::min(count, this->buffer.size());
+  if (!std::equal(words, words + count, this->buffer.begin()))
+    this->generation++;
+  std::copy(words, words + count, this->buffer.begin());
+}
 
 void Display::clear_buffer() {
-  std::fill(this->buffer.begin(), this->buffer.end(), false);
+  // Clearing a blank screen changes nothing
+  if (std::any_of(this->buffer.begin(), this->buffer.end(),
+                  [](uint64_t word) { return word != 0; }))
+    this->generation++;
+  std::fill(this->buffer.begin(), this->buffer.end(), 0);
 }
 
 void Display::toggle_pixel(unsigned int x, unsigned int y) {
-  int pixel = this->width * y + x;
-  if (pixel < buffer.size())
-    this->buffer[pixel] = !this->buffer[pixel];
-  else
+  if (x < this->width && y < this->height) {
+    this->buffer[y * this->words_per_row + x / 64] ^= 1ULL << (63 - x % 64);
+    this->generation++;
+  } else
     std::cout << "[ERROR] toggle_pixel: invalid pixel coordinates (" << x
               << ", " << y << ")" << std::endl;
 }
 
 bool Display::get_pixel(unsigned int x, unsigned int y) {
-  int pixel = this->width * y + x;
-  if (pixel > buffer.size()) {
+  if (x >= this->width || y >= this->height) {
     std::cout << "[ERROR] get_pixel: invalid pixel coordinates (" << x << ", "
               << y << ")" << std::endl;
     return false;
   }
 
-  return this->buffer[pixel];
+  return (this->buffer[y * this->words_per_row + x / 64] >> (63 - x % 64)) &
+         0b1;
+}
+
+bool Display::draw_sprite(unsigned int x, unsigned int y, const uint8_t *sprite,
+                          unsigned int rows, bool wrap) {
+  x %= this->width;
+  y %= this->height;
+  bool collision = false;
+
+  // Widths that are not a multiple of the word size wrap inside a word, draw
+  // those pixel by pixel
+  if (this->width % 64 != 0) {
+    for (unsigned int n = 0; n < rows; n++) {
+      if (!wrap && y + n >= this->height)
+        break;
+      unsigned int py = (y + n) % this->height;
+      for (unsigned int b = 0; b < 8; b++) {
+        if (!wrap && x + b >= this->width)
+          break;
+        unsigned int px = (x + b) % this->width;
+        if (!((sprite[n] >> (7 - b)) & 0b1))
+          continue;
+        collision |= this->get_pixel(px, py);
+        this->toggle_pixel(px, py);
+      }
+    }
+    return collision;
+  }
+
+  // The sprite byte lands in the word holding x, any pixels shifted out of
+  // its low end spill into the next word (the first one when wrapping)
+  unsigned int word = x / 64;
+  unsigned int shift = x % 64;
+  unsigned int spill_word = word + 1 == this->words_per_row ? 0 : word + 1;
+  bool spills = shift > 56 && (wrap || word + 1 < this->words_per_row);
+  // Blank or fully clipped sprite rows leave the screen untouched
+  uint64_t changed = 0;
+
+  for (unsigned int n = 0; n < rows; n++) {
+    if (!wrap && y + n >= this->height)
+      break;
+    uint64_t *row =
+        &this->buffer[((y + n) % this->height) * this->words_per_row];
+    uint64_t bits = static_cast<uint64_t>(sprite[n]) << 56;
+
+    // Collision when a sprite pixel lands on a lit pixel, XOR turns it off
+    uint64_t part = bits >> shift;
+    collision |= (row[word] & part) != 0;
+    row[word] ^= part;
+    changed |= part;
+    if (spills) {
+      uint64_t spill = bits << (64 - shift);
+      collision |= (row[spill_word] & spill) != 0;
+      row[spill_word] ^= spill;
+      changed |= spill;
+    }
+  }
+
+  if (changed)
+    this->generation++;
+  return collision;
+}
+
+uint64_t Display::get_generation() { return this->generation; }
+
+uint64_t Display::hash() {
+  uint64_t hash = 0xCBF29CE484222325;
+  for (uint64_t word : this->buffer) {
+    for (int i = 0; i < 8; i++) {
+      hash ^= (word >> (8 * i)) & 0xFF;
+      hash *= 0x100000001B3;
+    }
+  }
+  return hash;
 }
 
 const unsigned int Display::get_width() { return this->width; }
 const unsigned int Display::get_height() { return this->height; }
+const unsigned int Display::get_words_per_row() { return this->words_per_row; }
@@ -1,26 +1,46 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 class Display {
 public:
   Display(unsigned int width, unsigned int height);
 
-  const std::vector<bool> &get_buffer();
+  // Rows of pixels packed into 64-bit words, row y starts at word
+  // y * get_words_per_row() and the leftmost pixel is the most significant bit
+  const std::vector<uint64_t> &get_buffer();
+  // Replace every pixel with packed rows in the get_buffer() layout
+  void load_buffer(const uint64_t *words, size_t count);
   // Set all pixels in buffer to off
   void clear_buffer();
   // Flip pixel state
   void toggle_pixel(unsigned int x, unsigned int y);
   // Get pixel state
   bool get_pixel(unsigned int x, unsigned int y);
+  // XOR rows of an 8 pixel wide sprite onto the screen at (x, y), returns true
+  // if any lit pixel was turned off. The start position always wraps, pixels
+  // running past the right and bottom edges wrap around or are clipped.
+  bool draw_sprite(unsigned int x, unsigned int y, const uint8_t *sprite,
+                   unsigned int rows, bool wrap = true);
+
+  // Incremented whenever a pixel changes, compare against a previously seen
+  // value to skip work on unchanged frames
+  uint64_t get_generation();
+  // FNV-1a hash of the packed pixels, equal screens hash equal
+  uint64_t hash();
 
   const unsigned int get_width();
   const unsigned int get_height();
+  const unsigned int get_words_per_row();
 
 private:
   unsigned int width, height;
-  std::vector<bool> buffer;
+  unsigned int words_per_row;
+  std::vector<uint64_t> buffer;
+  uint64_t generation = 0;
 };
 
 #endif
@@ -0,0 +1,298 @@
+#include "emulator_thread.hpp"
+#include <algorithm>
+#include <iostream>
+
+EmulatorThread::EmulatorThread(CHIP8 *c8, const EmulatorConfig &config)
+    : c8(c8), config(config), scheduler(c8, config.cpu_hz),
+      rewind(config.rewind_seconds * Scheduler::timer_hz) {
+  // Size every frame's pixels once, publishing only copies into them
+  EmulatorFrame initial;
+  initial.pixels.resize(c8->display->get_buffer().size());
+  this->frames = std::make_unique<TripleBuffer<EmulatorFrame>>(initial);
+
+  // A frame's key events never outnumber the queue
+  this->key_events.reserve(256);
+
+  c8->seed_random(config.seed);
+  this->scheduler.set_tone(config.tone);
+  this->scheduler.set_debugger(&this->debugger);
+  this->log.seed = config.seed;
+  this->log.cpu_hz = this->scheduler.get_cpu_hz();
+  this->log.quirks = c8->get_quirks();
+}
+
+EmulatorThread::~EmulatorThread() { this->stop(); }
+
+void EmulatorThread::start() {
+  if (this->thread.joinable())
+    return;
+  this->stopping = false;
+  this->publish();
+  this->thread = std::thread(&EmulatorThread::run, this);
+}
+
+void EmulatorThread::stop() {
+  if (!this->thread.joinable())
+    return;
+  this->stopping = true;
+  this->thread.join();
+
+  if (!this->config.record_path.empty()) {
+    this->log.finish(this->scheduler.get_cycles());
+    if (this->log.save(this->config.record_path.c_str()))
+      std::cout << "[INFO] Recorded " << this->log.get_events().size()
+                << " key changes to " << this->config.record_path
+                << std::endl;
+  }
+}
+
+bool EmulatorThread::send(const EmulatorInput &input) {
+  return this->inputs.push(input);
+}
+
+bool EmulatorThread::update_frame() { return this->frames->update(); }
+
+const EmulatorFrame &EmulatorThread::get_frame() {
+  return this->frames->front();
+}
+
+void EmulatorThread::run() {
+  FramePacer pacer;
+  this->input_time = std::chrono::steady_clock::now();
+
+  while (!this->stopping.load(std::memory_order_relaxed)) {
+    // Key events from the last host frame start on this frame's first cycle
+    // and keep their spacing over the cycles it emulates. Unthrottled frames
+    // have no set length and rewinding or pausing runs no cycles, there they
+    // all apply now.
+    uint64_t span = 0;
+    if (!this->rewinding && !this->paused && !this->config.unthrottled)
+      span = this->scheduler.get_cycles_to_frame(this->config.turbo);
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    this->key_events.clear();
+    EmulatorInput input;
+    while (this->inputs.pop(input)) {
+      if (input.type == EmulatorInput::KEY_DOWN ||
+          input.type == EmulatorInput::KEY_UP)
+        this->queue_key(input, span, now);
+      else
+        this->apply_input(input);
+    }
+    this->input_time = now;
+    this->scheduler.set_input(&this->key_events, this->c8->keyboard);
+
+    // Advance emulated time by one frame (or several in turbo), unthrottled
+    // keeps emulating until this host frame's time is used up. While
+    // rewinding, go back one recorded frame instead. Paused, only the
+    // debugger's step messages move the machine.
+    if (this->rewinding) {
+      if (this->rewind.rewind(this->state) &&
+          load_state(*this->c8, this->state))
+        this->scheduler.update_tone();
+    } else if (this->paused) {
+    } else if (this->config.unthrottled) {
+      while (this->run_frame() &&
+             pacer.remaining() > std::chrono::steady_clock::duration::zero() &&
+             !this->c8->waiting_for_key()) {
+      }
+    } else {
+      for (unsigned int frame = 0; frame < this->config.turbo; frame++)
+        if (!this->run_frame())
+          break;
+    }
+    // Every event has been applied by now, unless a loaded or rewound state
+    // brought its own keys: the ones held on the host win
+    this->scheduler.set_input(nullptr, nullptr);
+    this->c8->keyboard->set_keys(this->held.get_keys());
+    if (!this->rewinding) {
+      save_state(*this->c8, this->state);
+      if (!this->paused)
+        this->rewind.push(this->state);
+    }
+
+    if (this->config.run_ahead > 0 && !this->rewinding && !this->paused)
+      this->publish_ahead();
+    else
+      this->publish();
+    pacer.wait();
+  }
+}
+
+bool EmulatorThread::run_frame() {
+  this->scheduler.run_frame();
+  this->stop_reason = this->scheduler.get_stop();
+  if (this->stop_reason == Debugger::NONE &&
+      (this->target_frame == 0 ||
+       this->scheduler.get_frames() < this->target_frame))
+    return true;
+  this->paused = true;
+  this->target_frame = 0;
+  return false;
+}
+
+void EmulatorThread::queue_key(const EmulatorInput &input, uint64_t span,
+                               std::chrono::steady_clock::time_point now) {
+  if (input.type == EmulatorInput::KEY_DOWN)
+    this->held.press(input.key);
+  else
+    this->held.release(input.key);
+
+  // The frame's first event applies on its first cycle, as early as the
+  // frame can see it. Later ones keep their host time distance from it,
+  // scaled from the host time since the last frame to the span, so a press
+  // and release within one host frame still hold the key that long.
+  uint64_t cycle = this->scheduler.get_cycles();
+  if (this->key_events.empty()) {
+    this->first_key_time = input.time;
+  } else {
+    std::chrono::duration<double> window = now - this->input_time;
+    if (span > 0 && window.count() > 0 && input.time > this->first_key_time) {
+      std::chrono::duration<double> offset =
+          std::min(input.time, now) - this->first_key_time;
+      cycle += std::min<uint64_t>(
+          span - 1, static_cast<uint64_t>(span * (offset / window)));
+    }
+  }
+  // Keep the events sorted should timestamps arrive out of order
+  if (!this->key_events.empty())
+    cycle = std::max(cycle, this->key_events.back().cycle);
+
+  this->key_events.push_back({cycle, this->held.get_keys()});
+  if (!this->config.record_path.empty())
+    this->log.record(cycle, this->held.get_keys());
+}
+
+void EmulatorThread::apply_input(const EmulatorInput &input) {
+  // Going back in time would break the recording's cycle order
+  bool recording = !this->config.record_path.empty();
+  const char *state_path = this->config.state_path.c_str();
+
+  switch (input.type) {
+  case EmulatorInput::KEY_DOWN:
+  case EmulatorInput::KEY_UP:
+    // Queued by run() instead
+    break;
+  case EmulatorInput::SAVE_STATE:
+    save_state(*this->c8, this->state);
+    if (write_savestate(state_path, this->state))
+      std::cout << "[INFO] Saved state to " << state_path << std::endl;
+    break;
+  case EmulatorInput::LOAD_STATE:
+    if (!recording && read_savestate(state_path, this->state) &&
+        load_state(*this->c8, this->state)) {
+      // History from before the load no longer leads here
+      this->rewind.clear();
+      this->scheduler.update_tone();
+      std::cout << "[INFO] Loaded state from " << state_path << std::endl;
+    }
+    break;
+  case EmulatorInput::REWIND_START:
+    this->rewinding = !recording;
+    break;
+  case EmulatorInput::REWIND_STOP:
+    this->rewinding = false;
+    break;
+  case EmulatorInput::RESET_PROFILE:
+    PROFILE_HOOK(this->c8->profile.reset();)
+    break;
+  case EmulatorInput::PAUSE:
+    this->paused = true;
+    this->target_frame = 0;
+    break;
+  case EmulatorInput::CONTINUE:
+    if (this->paused)
+      this->debugger.resume();
+    this->paused = false;
+    this->stop_reason = Debugger::NONE;
+    break;
+  case EmulatorInput::STEP:
+  case EmulatorInput::STEP_OVER:
+    if (!this->paused || this->rewinding)
+      break;
+    this->stop_reason = Debugger::NONE;
+    // A call runs until it returns like a continue, anything else is a
+    // single instruction either way
+    if (input.type == EmulatorInput::STEP_OVER &&
+        this->c8->PC < CHIP8::memory_size - 1 &&
+        (this->c8->memory[this->c8->PC] & 0xF0) == 0x20) {
+      this->debugger.step_over(*this->c8);
+      this->paused = false;
+    } else {
+      this->debugger.resume();
+      this->scheduler.run_cycles(1);
+    }
+    break;
+  case EmulatorInput::RUN_TO_FRAME:
+    // Runs on from a stop, frames already passed pause right away
+    this->target_frame = std::max<uint64_t>(input.value, 1);
+    if (this->paused)
+      this->debugger.resume();
+    this->paused = this->scheduler.get_frames() >= this->target_frame;
+    this->stop_reason = Debugger::NONE;
+    break;
+  case EmulatorInput::TOGGLE_BREAKPOINT:
+    this->debugger.toggle(Debugger::BREAKPOINT, input.value);
+    break;
+  case EmulatorInput::TOGGLE_READ_WATCHPOINT:
+    this->debugger.toggle(Debugger::READ_WATCHPOINT, input.value);
+    break;
+  case EmulatorInput::TOGGLE_WRITE_WATCHPOINT:
+    this->debugger.toggle(Debugger::WRITE_WATCHPOINT, input.value);
+    break;
+  }
+}
+
+void EmulatorThread::publish_ahead() {
+  // this->state already holds the real frame for rewinding and both
+  // snapshots are plain members, so besides the extra frames this only costs
+  // a load_state() and never touches the heap. The tone only ever hears the
+  // real frames.
+  this->scheduler.save(this->position);
+  PROFILE_HOOK(this->real_profile = this->c8->profile;)
+  this->scheduler.set_tone(nullptr);
+  this->scheduler.set_debugger(nullptr);
+  for (unsigned int frame = 0; frame < this->config.run_ahead; frame++)
+    this->scheduler.run_frame();
+  this->publish(true);
+  load_state(*this->c8, this->state);
+  this->scheduler.restore(this->position);
+  PROFILE_HOOK(this->c8->profile = this->real_profile;)
+  this->scheduler.set_debugger(&this->debugger);
+}
+
+void EmulatorThread::publish(bool ahead) {
+  EmulatorFrame &frame = this->frames->back();
+  Display *display = this->c8->display;
+
+  const std::vector<uint64_t> &buffer = display->get_buffer();
+  frame.pixels.assign(buffer.begin(), buffer.end());
+  frame.width = display->get_width();
+  frame.height = display->get_height();
+  frame.words_per_row = display->get_words_per_row();
+  frame.generation = display->get_generation();
+
+  frame.V = this->c8->V;
+  frame.opcode = this->c8->opcode;
+  frame.PC = this->c8->PC;
+  frame.I = this->c8->I;
+  frame.SP = this->c8->SP;
+  frame.DT = this->c8->DT;
+  frame.ST = this->c8->ST;
+  frame.keys = this->c8->keyboard->get_keys();
+  frame.waiting_for_key = this->c8->waiting_for_key();
+  frame.memory = this->c8->memory;
+  frame.debugger = this->debugger;
+  frame.paused = this->paused;
+  frame.stop = this->stop_reason;
+
+  frame.cycles = ahead ? this->position.cycles : this->scheduler.get_cycles();
+  frame.frames = ahead ? this->position.ticks : this->scheduler.get_frames();
+  frame.rewind_frames = this->rewind.size();
+  frame.rewind_bytes = this->rewind.delta_bytes();
+#ifdef CHIP8_PROFILE
+  frame.profile = ahead ? this->real_profile : this->c8->profile;
+#endif
+
+  this->frames->publish();
+}
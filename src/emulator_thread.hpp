@@ -0,0 +1,191 @@
+#ifndef EMULATOR_THREAD_H
+#define EMULATOR_THREAD_H
+
+#include "chip8.hpp"
+#include "debugger.hpp"
+#include "input_log.hpp"
+#include "keyboard.hpp"
+#include "savestate.hpp"
+#include "scheduler.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct EmulatorConfig {
+  unsigned int cpu_hz = Scheduler::default_cpu_hz;
+  // Random seed the CHIP8 is restarted with, recorded in the input log
+  uint64_t seed = CHIP8::default_seed;
+  // Emulated frames per host frame
+  unsigned int turbo = 1;
+  // Emulate as many frames as fit in each host frame
+  bool unthrottled = false;
+  // Show the frame this many frames ahead of the real one, emulated with
+  // the keys held now and thrown away after publishing. Hides that much
+  // latency in games that read input once per frame.
+  unsigned int run_ahead = 0;
+  // Seconds of history kept for rewinding, one state per host frame
+  unsigned int rewind_seconds = 300;
+  // File used by SAVE_STATE and LOAD_STATE
+  std::string state_path;
+  // Input log written when the thread stops (empty to not record). Loading
+  // states and rewinding are ignored while recording.
+  std::string record_path;
+  // Receives the sound timer's edges (nullptr for no sound), must outlive
+  // the thread
+  ToneSynth *tone = nullptr;
+};
+
+// Message from the render thread to the emulation thread
+struct EmulatorInput {
+  enum Type {
+    // key went down or up at time
+    KEY_DOWN,
+    KEY_UP,
+    SAVE_STATE,
+    LOAD_STATE,
+    REWIND_START,
+    REWIND_STOP,
+    RESET_PROFILE,
+    // Debugger controls. Stepping only acts while paused, breakpoints and
+    // watchpoints pause as well.
+    PAUSE,
+    CONTINUE,
+    STEP,
+    // Step, running a 2NNN's whole call
+    STEP_OVER,
+    // Run until value timer ticks have passed since the start
+    RUN_TO_FRAME,
+    // Toggle the breakpoint or watchpoint at address value
+    TOGGLE_BREAKPOINT,
+    TOGGLE_READ_WATCHPOINT,
+    TOGGLE_WRITE_WATCHPOINT
+  };
+  Type type = Type::KEY_DOWN;
+  Key key = Key::NONE;
+  // Host time the key event happened, it is applied at the emulated cycle
+  // with the same offset into the next frame
+  std::chrono::steady_clock::time_point time{};
+  uint64_t value = 0;
+};
+
+// Everything the render thread shows for one emulated frame
+struct EmulatorFrame {
+  // Packed display rows, same layout as Display::get_buffer()
+  std::vector<uint64_t> pixels;
+  unsigned int width = 0;
+  unsigned int height = 0;
+  unsigned int words_per_row = 0;
+  uint64_t generation = 0;
+
+  std::array<uint8_t, 16> V{};
+  uint16_t opcode = 0;
+  uint16_t PC = 0;
+  uint16_t I = 0;
+  uint8_t SP = 0;
+  uint8_t DT = 0;
+  uint8_t ST = 0;
+  // Keyboard bitmask, bit K set while key K is held
+  uint16_t keys = 0;
+  bool waiting_for_key = false;
+  std::array<uint8_t, CHIP8::memory_size> memory{};
+  Debugger debugger;
+  bool paused = false;
+  // Why the machine last paused by itself
+  Debugger::Stop stop = Debugger::NONE;
+
+  uint64_t cycles = 0;
+  uint64_t frames = 0;
+  size_t rewind_frames = 0;
+  size_t rewind_bytes = 0;
+#ifdef CHIP8_PROFILE
+  Profile profile;
+#endif
+};
+
+// Runs a CHIP8 on its own thread at 60 frames per second. Input arrives
+// through a lock-free queue. Key events carry their host time: the ones
+// that happened during the last host frame are spread over the cycles of
+// the next one at the same offsets, so every key change reaches the
+// emulated machine exactly one frame after it happened, however the event
+// fell relative to the frame boundary. Every finished frame is published
+// through a triple buffer so the render thread always picks up the newest
+// one and neither side waits on the other.
+//
+// Once started the thread owns the CHIP8, its Display and Keyboard; the
+// caller only talks to it through send() and the published frames.
+class EmulatorThread {
+public:
+  EmulatorThread(CHIP8 *c8, const EmulatorConfig &config);
+  ~EmulatorThread();
+  EmulatorThread(const EmulatorThread &) = delete;
+  EmulatorThread &operator=(const EmulatorThread &) = delete;
+
+  void start();
+  // Finish the current frame, join the thread and write the input log
+  void stop();
+
+  // Render thread: queue input for the next frame, returns false when the
+  // queue is full
+  bool send(const EmulatorInput &input);
+  // Render thread: switch to the newest published frame without blocking,
+  // returns false when no new frame was published since the last call
+  bool update_frame();
+  const EmulatorFrame &get_frame();
+
+private:
+  void run();
+  void apply_input(const EmulatorInput &input);
+  // Turn a key event into a key change within the next span cycles, the
+  // frame's first event on the first of them
+  void queue_key(const EmulatorInput &input, uint64_t span,
+                 std::chrono::steady_clock::time_point now);
+  // Copy the machine into a frame for the main thread. A frame run ahead
+  // shows the speculative machine but the real position and counters, saved
+  // in position and real_profile.
+  void publish(bool ahead = false);
+  // Emulate one frame, returns false (and pauses) when the debugger stopped
+  // it or it reached the RUN_TO_FRAME target
+  bool run_frame();
+  // Run config.run_ahead frames past the state just saved, publish the last
+  // one and return to the saved state
+  void publish_ahead();
+
+  CHIP8 *c8;
+  EmulatorConfig config;
+  Scheduler scheduler;
+  RewindBuffer rewind;
+  Savestate state;
+  Scheduler::Snapshot position;
+#ifdef CHIP8_PROFILE
+  Profile real_profile;
+#endif
+  InputLog log;
+  bool rewinding = false;
+  Debugger debugger;
+  bool paused = false;
+  Debugger::Stop stop_reason = Debugger::NONE;
+  // Frame RUN_TO_FRAME pauses on, 0 for none
+  uint64_t target_frame = 0;
+  // Keys held on the host after the last queued event, and the key changes
+  // of the frame being emulated (allocated once)
+  Keyboard held;
+  std::vector<InputEvent> key_events;
+  // Start of the host time covered by the key events being queued, and the
+  // time of the first of them
+  std::chrono::steady_clock::time_point input_time;
+  std::chrono::steady_clock::time_point first_key_time;
+
+  SpscQueue<EmulatorInput, 256> inputs;
+  std::unique_ptr<TripleBuffer<EmulatorFrame>> frames;
+  std::atomic<bool> stopping{false};
+  std::thread thread;
+};
+
+#endif
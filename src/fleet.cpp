@@ -0,0 +1,147 @@
+#include "fleet.hpp"
+#include "display.hpp"
+#include "keyboard.hpp"
+#include "lanes.hpp"
+#include "rom_file.hpp"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <utility>
+
+#define DISPLAY_WIDTH 64
+#define DISPLAY_HEIGHT 32
+
+static void store_state(FleetResult &result, const CHIP8 &c8,
+                        Display &display) {
+  result.display_hash = display.hash();
+  result.V = c8.V;
+  result.I = c8.I;
+  result.PC = c8.PC;
+  result.SP = c8.SP;
+  result.DT = c8.DT;
+  result.ST = c8.ST;
+}
+
+// Jobs grouped by rom and profile, each group split into LaneEngines of at
+// most max_lanes lanes. Timers tick on the same cycles the Scheduler uses.
+static void run_lanes(const std::vector<FleetJob> &jobs,
+                      const FleetConfig &config,
+                      std::vector<FleetResult> &results, ThreadPool &pool) {
+  std::map<std::pair<std::string, QuirkProfile>, std::vector<size_t>> groups;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    results[i].rom = jobs[i].rom;
+    results[i].seed = jobs[i].seed;
+    groups[{jobs[i].rom, jobs[i].quirks}].push_back(i);
+  }
+
+  unsigned int cpu_hz = config.cpu_hz < Scheduler::timer_hz
+                            ? Scheduler::timer_hz
+                            : config.cpu_hz;
+  uint64_t total = config.cycles > 0
+                       ? config.cycles
+                       : config.frames * cpu_hz / Scheduler::timer_hz;
+  for (auto &group : groups) {
+    const std::vector<size_t> &members = group.second;
+    for (size_t first = 0; first < members.size();
+         first += LaneEngine::max_lanes) {
+      size_t count =
+          std::min<size_t>(members.size() - first, LaneEngine::max_lanes);
+      pool.submit([&, first, count] {
+        RomFile rom;
+        if (!rom.open(jobs[members[first]].rom.c_str()))
+          return;
+        auto lanes =
+            std::make_unique<LaneEngine>(count, jobs[members[first]].quirks);
+        if (!lanes->load_rom(rom.data(), rom.size()))
+          return;
+        rom.close();
+        for (size_t lane = 0; lane < count; lane++)
+          lanes->seed_random(lane, jobs[members[first + lane]].seed);
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t cycles = 0;
+        for (uint64_t tick = 1; cycles < total; tick++) {
+          uint64_t next_tick = tick * cpu_hz / Scheduler::timer_hz;
+          uint64_t target = std::min(total, next_tick);
+          lanes->step_all(target - cycles);
+          cycles = target;
+          if (cycles == next_tick)
+            lanes->tick_timers();
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        Display display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        Keyboard keyboard;
+        auto c8 = std::make_unique<CHIP8>(&display, &keyboard);
+        for (size_t lane = 0; lane < count; lane++) {
+          FleetResult &result = results[members[first + lane]];
+          lanes->export_lane(lane, *c8, display);
+          store_state(result, *c8, display);
+          result.loaded = true;
+          result.cycles = cycles;
+          // The lanes ran together, each gets an even share of the time
+          result.seconds = seconds / count;
+        }
+      });
+    }
+  }
+  pool.wait();
+}
+
+std::vector<FleetResult> run_fleet(const std::vector<FleetJob> &jobs,
+                                   const FleetConfig &config) {
+  std::vector<FleetResult> results(jobs.size());
+  ThreadPool pool(config.threads);
+  if (config.lanes) {
+    run_lanes(jobs, config, results, pool);
+    return results;
+  }
+
+  for (size_t i = 0; i < jobs.size(); i++) {
+    pool.submit([&, i] {
+      const FleetJob &job = jobs[i];
+      FleetResult &result = results[i];
+      result.rom = job.rom;
+      result.seed = job.seed;
+
+      // Each task maps its own rom, so opening runs in parallel and only as
+      // many roms as there are workers are mapped at once
+      RomFile rom;
+      if (!rom.open(job.rom.c_str()))
+        return;
+
+      // Everything an instance touches is owned by this task
+      Display display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+      Keyboard keyboard;
+      auto c8 = std::make_unique<CHIP8>(&display, &keyboard);
+      c8->set_engine(config.engine);
+      c8->set_quirks(job.quirks);
+      c8->seed_random(job.seed);
+      if (!c8->load_rom(rom.data(), rom.size()))
+        return;
+      rom.close();
+      result.loaded = true;
+
+      Scheduler scheduler(c8.get(), config.cpu_hz);
+      auto start = std::chrono::steady_clock::now();
+      if (config.cycles > 0) {
+        scheduler.run_cycles(config.cycles);
+      } else {
+        for (uint64_t frame = 0; frame < config.frames; frame++)
+          scheduler.run_frame();
+      }
+      auto end = std::chrono::steady_clock::now();
+
+      result.seconds = std::chrono::duration<double>(end - start).count();
+      result.cycles = scheduler.get_cycles();
+      store_state(result, *c8, display);
+    });
+  }
+  pool.wait();
+
+  return results;
+}
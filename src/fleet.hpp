@@ -0,0 +1,54 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "chip8.hpp"
+#include "scheduler.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One emulator instance to run
+struct FleetJob {
+  std::string rom;
+  uint64_t seed = CHIP8::default_seed;
+  QuirkProfile quirks = QUIRKS_DEFAULT;
+};
+
+struct FleetConfig {
+  // Budget per instance, cycles takes precedence over frames
+  uint64_t cycles = 0;
+  uint64_t frames = 0;
+  unsigned int cpu_hz = Scheduler::default_cpu_hz;
+  Engine engine = Engine::INTERPRETER;
+  // Run jobs with the same rom and quirk profile together on LaneEngines
+  // instead, up to LaneEngine::max_lanes per engine (engine is ignored)
+  bool lanes = false;
+  // Zero uses one thread per hardware thread
+  unsigned int threads = 0;
+};
+
+// Final state of one instance
+struct FleetResult {
+  std::string rom;
+  uint64_t seed = 0;
+  bool loaded = false;
+  uint64_t display_hash = 0;
+  std::array<uint8_t, 16> V{};
+  uint16_t I = 0;
+  uint16_t PC = 0;
+  uint8_t SP = 0;
+  uint8_t DT = 0;
+  uint8_t ST = 0;
+  uint64_t cycles = 0;
+  // Wall time spent emulating this instance
+  double seconds = 0;
+};
+
+// Run every job on its own CHIP8, Display and Keyboard (or on one lane of a
+// LaneEngine) spread over a work-stealing thread pool. Results are in job
+// order.
+std::vector<FleetResult> run_fleet(const std::vector<FleetJob> &jobs,
+                                   const FleetConfig &config);
+
+#endif
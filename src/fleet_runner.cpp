@@ -0,0 +1,147 @@
+#include "fleet.hpp"
+#include "rom_library.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static void print_usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [--cycles N | --frames N] [--hz N] [--threads N]"
+               " [--instances N] [--seed N]"
+               " [--engine interpreter|cached|jit|threaded|lanes]"
+               " [--library DIR [--index FILE]] <rom>..."
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  FleetConfig config;
+  // Instances per rom, each gets its own seed
+  uint64_t instances = 1;
+  uint64_t seed = CHIP8::default_seed;
+  std::vector<std::string> roms;
+  // Every rom under library is run too, its index defaults to a file in it
+  const char *library_root = nullptr;
+  std::string index_path;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      config.cycles = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      config.frames = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--hz") == 0 && i + 1 < argc) {
+      config.cpu_hz = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      config.threads = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+      instances = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      i++;
+      if (std::strcmp(argv[i], "interpreter") == 0) {
+        config.engine = Engine::INTERPRETER;
+      } else if (std::strcmp(argv[i], "cached") == 0) {
+        config.engine = Engine::CACHED;
+      } else if (std::strcmp(argv[i], "jit") == 0) {
+        config.engine = Engine::JIT;
+      } else if (std::strcmp(argv[i], "threaded") == 0) {
+        config.engine = Engine::THREADED;
+      } else if (std::strcmp(argv[i], "lanes") == 0) {
+        config.lanes = true;
+      } else {
+        std::cerr << "[ERROR] Unknown engine: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--library") == 0 && i + 1 < argc) {
+      library_root = argv[++i];
+    } else if (std::strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+      index_path = argv[++i];
+    } else if (argv[i][0] != '-') {
+      roms.push_back(argv[i]);
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // Only roms that are new or changed since the index was saved are read
+  RomLibrary library;
+  if (library_root != nullptr) {
+    if (index_path.empty())
+      index_path = std::string(library_root) + "/" +
+                   RomLibrary::default_index_name;
+    if (!library.load(index_path.c_str()))
+      return 1;
+    auto start = std::chrono::steady_clock::now();
+    size_t hashed = library.scan(library_root, config.threads);
+    auto end = std::chrono::steady_clock::now();
+    std::cerr << "[INFO] " << library.get_entries().size() << " roms indexed ("
+              << hashed << " hashed) in "
+              << std::chrono::duration<double>(end - start).count() << " s"
+              << std::endl;
+  }
+
+  if (roms.empty() && library.get_entries().empty()) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  // Default to one second of emulated time
+  if (config.cycles == 0 && config.frames == 0)
+    config.frames = Scheduler::timer_hz;
+
+  std::vector<FleetJob> jobs;
+  for (const std::string &rom : roms)
+    for (uint64_t instance = 0; instance < instances; instance++)
+      jobs.push_back({rom, seed + instance});
+  // Library jobs follow, with the profile the index detected
+  size_t library_start = jobs.size();
+  for (const RomEntry &entry : library.get_entries())
+    for (uint64_t instance = 0; instance < instances; instance++)
+      jobs.push_back({library.full_path(entry), seed + instance, entry.quirks});
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<FleetResult> results = run_fleet(jobs, config);
+  auto end = std::chrono::steady_clock::now();
+
+  // One CSV record per instance
+  std::printf("rom,seed,loaded,display_hash,pc,i,sp,dt,st,v,cycles,seconds\n");
+  uint64_t total_cycles = 0;
+  bool failed = false;
+  for (const FleetResult &result : results) {
+    char registers[33];
+    for (int x = 0; x < 16; x++)
+      std::snprintf(&registers[2 * x], 3, "%02x", result.V[x]);
+    std::printf("%s,%llu,%d,%016llx,%03x,%03x,%u,%u,%u,%s,%llu,%.6f\n",
+                result.rom.c_str(), (unsigned long long)result.seed,
+                result.loaded, (unsigned long long)result.display_hash,
+                result.PC, result.I, result.SP, result.DT, result.ST,
+                registers, (unsigned long long)result.cycles, result.seconds);
+    total_cycles += result.cycles;
+    failed |= !result.loaded;
+  }
+
+  if (library_root != nullptr) {
+    // Every instance counts as a run, the last one's stats are kept
+    for (size_t i = library_start; i < results.size(); i++) {
+      const FleetResult &result = results[i];
+      RomEntry *entry = library.find(result.rom);
+      if (entry != nullptr && result.loaded)
+        library.record_run(*entry, result.cycles, result.display_hash,
+                           result.seconds);
+    }
+    if (!library.save(index_path.c_str()))
+      failed = true;
+  }
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  std::cerr << "[INFO] " << results.size() << " instances, " << total_cycles
+            << " instructions in " << seconds << " s ("
+            << (seconds > 0 ? total_cycles / seconds : 0.0)
+            << " instructions/sec)" << std::endl;
+
+  return failed ? 1 : 0;
+}
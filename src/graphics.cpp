@@ -8,6 +8,10 @@ SDL init_sdl(std::string title, uint w, uint h) {
   if (!SDL_Init(SDL_INIT_VIDEO)) {
     SDL_LogError(0, "[ERROR] SDL_Init: %s\n", SDL_GetError());
   }
+  // Audio separately, without a device the emulator still runs silently
+  if (!SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+    SDL_LogError(0, "[ERROR] SDL_InitSubSystem(audio): %s\n", SDL_GetError());
+  }
 
   // Window to render things onto
   SDL_Window *window = SDL_CreateWindow("CHIP-8", w, h, SDL_WINDOW_RESIZABLE);
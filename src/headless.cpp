@@ -0,0 +1,214 @@
+#include "analyzer.hpp"
+#include "capture.hpp"
+#include "chip8.hpp"
+#include "display.hpp"
+#include "input_log.hpp"
+#include "keyboard.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#define DISPLAY_WIDTH 64
+#define DISPLAY_HEIGHT 32
+
+static void print_usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " <rom> [--cycles N | --frames N] [--hz N] [--seed N]"
+               " [--replay FILE] [--profile FILE.json|FILE.csv]"
+               " [--engine interpreter|cached|jit|threaded] [--prewarm]"
+               " [--no-idle-skip] [--capture FILE.raw|FILE.y4m|FILE.png]"
+               " [--scale N] [--quirks default|vip|chip48|schip]"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  const char *rom = nullptr;
+  uint64_t cycles = 0;
+  uint64_t frames = 0;
+  unsigned int cpu_hz = Scheduler::default_cpu_hz;
+  Engine engine = Engine::INTERPRETER;
+  uint64_t seed = CHIP8::default_seed;
+  bool seed_given = false;
+  bool hz_given = false;
+  const char *replay = nullptr;
+#ifdef CHIP8_PROFILE
+  const char *profile = nullptr;
+#endif
+  bool prewarm = false;
+  bool idle_skip = true;
+  const char *capture_path = nullptr;
+  unsigned int scale = 8;
+  QuirkProfile quirks = QUIRKS_DEFAULT;
+  bool quirks_given = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      cycles = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--hz") == 0 && i + 1 < argc) {
+      cpu_hz = std::strtoul(argv[++i], nullptr, 10);
+      hz_given = true;
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = std::strtoull(argv[++i], nullptr, 10);
+      seed_given = true;
+    } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay = argv[++i];
+    } else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+#ifdef CHIP8_PROFILE
+      profile = argv[++i];
+#else
+      std::cerr << "[ERROR] --profile needs a build configured with "
+                   "-DCHIP8_PROFILE=ON"
+                << std::endl;
+      return 1;
+#endif
+    } else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      i++;
+      if (std::strcmp(argv[i], "interpreter") == 0) {
+        engine = Engine::INTERPRETER;
+      } else if (std::strcmp(argv[i], "cached") == 0) {
+        engine = Engine::CACHED;
+      } else if (std::strcmp(argv[i], "jit") == 0) {
+        engine = Engine::JIT;
+      } else if (std::strcmp(argv[i], "threaded") == 0) {
+        engine = Engine::THREADED;
+      } else {
+        std::cerr << "[ERROR] Unknown engine: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--prewarm") == 0) {
+      prewarm = true;
+    } else if (std::strcmp(argv[i], "--no-idle-skip") == 0) {
+      idle_skip = false;
+    } else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+      capture_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+      scale = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+      if (!parse_quirk_profile(argv[++i], quirks)) {
+        std::cerr << "[ERROR] Unknown quirk profile: " << argv[i] << std::endl;
+        return 1;
+      }
+      quirks_given = true;
+    } else if (argv[i][0] != '-' && rom == nullptr) {
+      rom = argv[i];
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (rom == nullptr) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  // A replay reproduces the recorded session's seed, rate, quirk profile and
+  // length unless told otherwise
+  InputLog log;
+  if (replay != nullptr) {
+    if (!log.load(replay))
+      return 1;
+    if (!seed_given)
+      seed = log.seed;
+    if (!hz_given)
+      cpu_hz = log.cpu_hz;
+    if (!quirks_given && log.quirks_recorded) {
+      quirks = log.quirks;
+      quirks_given = true;
+    }
+    if (cycles == 0 && frames == 0)
+      cycles = log.end_cycle;
+  }
+
+  // Default to one second of emulated time
+  if (cycles == 0 && frames == 0)
+    frames = Scheduler::timer_hz;
+
+  Display display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+  Keyboard keyboard;
+  CHIP8 c8(&display, &keyboard);
+  c8.set_engine(engine);
+  c8.set_quirks(quirks_given ? quirks : quirk_profile_for_rom(rom));
+  c8.seed_random(seed);
+  if (!c8.load_rom(rom))
+    return 1;
+  // Decode or translate everything static analysis finds before the clock
+  // starts (the whole program area is analyzed since the rom size is gone)
+  if (prewarm) {
+    RomAnalysis analysis;
+    analysis.analyze(c8.memory.data() + CHIP8::program_start_address,
+                     CHIP8::max_rom_size);
+    c8.prewarm(analysis);
+  }
+
+  Scheduler scheduler(&c8, cpu_hz);
+  scheduler.set_idle_skip(idle_skip);
+  if (replay != nullptr)
+    scheduler.set_input(&log.get_events(), &keyboard);
+
+  // Frames are captured at every timer tick, the writer runs on its own
+  // thread alongside the emulator
+  FrameCapture capture;
+  if (capture_path != nullptr &&
+      !capture.start(capture_path, FrameCapture::format_for(capture_path),
+                     display, scale))
+    return 1;
+
+  // Run the emulator as fast as possible
+  auto start = std::chrono::steady_clock::now();
+  if (capture_path == nullptr && cycles > 0) {
+    scheduler.run_cycles(cycles);
+  } else if (cycles > 0) {
+    while (scheduler.get_cycles() < cycles) {
+      uint64_t frame = scheduler.get_frames();
+      scheduler.run_cycles(std::min(cycles - scheduler.get_cycles(),
+                                    scheduler.get_cycles_to_frame()));
+      if (scheduler.get_frames() != frame)
+        capture.push(display);
+    }
+  } else {
+    for (uint64_t frame = 0; frame < frames; frame++) {
+      scheduler.run_frame();
+      capture.push(display);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  cycles = scheduler.get_cycles();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << "[INFO] Executed " << cycles << " instructions ("
+            << scheduler.get_frames() << " frames) in " << seconds
+            << " s (" << (seconds > 0 ? cycles / seconds : 0.0)
+            // With idle skip, skipped spin loop iterations count as executed
+            << (idle_skip ? " emulated" : "") << " instructions/sec)"
+            << std::endl;
+  // Identical runs print identical hashes, whichever engine or build ran them
+  std::cout << "[INFO] Display hash " << std::hex << display.hash()
+            << std::dec << std::endl;
+
+  if (capture_path != nullptr) {
+    if (!capture.stop())
+      return 1;
+    std::cout << "[INFO] Captured " << capture.get_frames() << " frames as "
+              << capture.get_records() << " records to " << capture_path
+              << " (" << capture.get_stalls() << " stalls)" << std::endl;
+  }
+
+#ifdef CHIP8_PROFILE
+  if (profile != nullptr && !c8.profile.write(profile))
+    return 1;
+#endif
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include "input_log.hpp"
+#include "byte_io.hpp"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+void InputLog::record(uint64_t cycle, uint16_t keys) {
+  uint16_t held = this->events.empty() ? 0 : this->events.back().keys;
+  if (keys == held)
+    return;
+  this->events.push_back({cycle, keys});
+}
+
+void InputLog::finish(uint64_t cycle) { this->end_cycle = cycle; }
+
+const std::vector<InputEvent> &InputLog::get_events() { return this->events; }
+
+bool InputLog::save(const char *filename) {
+  std::vector<uint8_t> out;
+  put_uint(out, InputLog::magic_value, 4);
+  put_uint(out, InputLog::version_value, 4);
+  put_uint(out, this->seed, 8);
+  put_uint(out, this->cpu_hz, 4);
+  put_uint(out, this->quirks, 1);
+  put_uint(out, this->end_cycle, 8);
+  put_uint(out, this->events.size(), 4);
+
+  uint64_t previous = 0;
+  for (const InputEvent &event : this->events) {
+    uint64_t delta = event.cycle - previous;
+    previous = event.cycle;
+    do {
+      out.push_back((delta & 0x7F) | (delta >= 0x80 ? 0x80 : 0));
+      delta >>= 7;
+    } while (delta != 0);
+    put_uint(out, event.keys, 2);
+  }
+
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+  file.write(reinterpret_cast<const char *>(out.data()), out.size());
+  return static_cast<bool>(file);
+}
+
+bool InputLog::load(const char *filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+  std::vector<uint8_t> in((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+
+  size_t position = 0;
+  uint64_t magic, version, seed, cpu_hz, end_cycle, count;
+  uint64_t quirks = QUIRKS_DEFAULT;
+  if (!get_uint(in, position, 4, magic) || magic != InputLog::magic_value) {
+    std::cerr << "[ERROR] " << filename << " is not an input log" << std::endl;
+    return false;
+  }
+  if (!get_uint(in, position, 4, version)) {
+    std::cerr << "[ERROR] " << filename << " is truncated" << std::endl;
+    return false;
+  }
+  if (version < 1 || version > InputLog::version_value) {
+    std::cerr << "[ERROR] Input log version " << version
+              << " is not supported" << std::endl;
+    return false;
+  }
+  if (!get_uint(in, position, 8, seed) || !get_uint(in, position, 4, cpu_hz) ||
+      (version >= 3 && !get_uint(in, position, 1, quirks)) ||
+      !get_uint(in, position, 8, end_cycle) ||
+      !get_uint(in, position, 4, count)) {
+    std::cerr << "[ERROR] " << filename << " is truncated" << std::endl;
+    return false;
+  }
+  if (quirks > QUIRKS_SCHIP) {
+    std::cerr << "[ERROR] Input log quirk profile " << quirks
+              << " is not supported" << std::endl;
+    return false;
+  }
+
+  std::vector<InputEvent> events;
+  uint64_t cycle = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t delta = 0;
+    int shift = 0;
+    while (position < in.size() && shift < 64) {
+      uint8_t byte = in[position++];
+      delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      shift += 7;
+      if ((byte & 0x80) == 0)
+        break;
+    }
+    uint64_t keys;
+    if (version == 1) {
+      // One held key or none
+      if (!get_uint(in, position, 1, keys) || keys > Key::NONE) {
+        std::cerr << "[ERROR] " << filename << " is truncated" << std::endl;
+        return false;
+      }
+      keys = keys == Key::NONE ? 0 : 1u << keys;
+    } else if (!get_uint(in, position, 2, keys)) {
+      std::cerr << "[ERROR] " << filename << " is truncated" << std::endl;
+      return false;
+    }
+    cycle += delta;
+    events.push_back({cycle, static_cast<uint16_t>(keys)});
+  }
+
+  this->seed = seed;
+  this->cpu_hz = cpu_hz;
+  this->quirks = static_cast<QuirkProfile>(quirks);
+  this->quirks_recorded = version >= 3;
+  this->end_cycle = end_cycle;
+  this->events = std::move(events);
+  return true;
+}
@@ -0,0 +1,54 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include "keyboard.hpp"
+#include "quirks.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Key state change taking effect before the instruction at this cycle, keys
+// is the whole Keyboard bitmask from then on
+struct InputEvent {
+  uint64_t cycle;
+  uint16_t keys;
+};
+
+// Everything needed to replay a session bit for bit: the random seed, the
+// instruction rate, the quirk profile and every key change keyed by cycle
+// number.
+//
+// File layout (little endian): "C8IN" magic, u32 version, u64 seed, u32
+// cpu_hz, u8 quirk profile, u64 end cycle, u32 event count, then per event
+// the cycle delta from the previous event as a LEB128 varint followed by the
+// u16 key bitmask. Version 2 logs (no quirk profile) and version 1 logs
+// (also a single key byte, 0x10 for none) still load.
+class InputLog {
+public:
+  static const uint32_t magic_value = 0x4E493843; // "C8IN"
+  static const uint32_t version_value = 3;
+
+  // Append a key change, events that leave the held keys as they are are
+  // dropped
+  void record(uint64_t cycle, uint16_t keys);
+  // Cycle the recorded session ended on
+  void finish(uint64_t cycle);
+
+  bool save(const char *filename);
+  bool load(const char *filename);
+
+  const std::vector<InputEvent> &get_events();
+
+  uint64_t seed = 0;
+  unsigned int cpu_hz = 0;
+  QuirkProfile quirks = QUIRKS_DEFAULT;
+  // False for logs older than version 3, which ran with whatever profile
+  // the rom's name implied
+  bool quirks_recorded = false;
+  uint64_t end_cycle = 0;
+
+private:
+  std::vector<InputEvent> events;
+};
+
+#endif
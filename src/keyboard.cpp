@@ -1,4 +1,24 @@
 #include "keyboard.hpp"
 
-void Keyboard::set_pressed_key(Key key) { this->pressed = key; }
-Key Keyboard::get_pressed_key() { return this->pressed; }
+void Keyboard::press(Key key) {
+  if (key < Key::NONE)
+    this->keys |= 1u << key;
+}
+
+void Keyboard::release(Key key) {
+  if (key < Key::NONE)
+    this->keys &= ~(1u << key);
+}
+
+void Keyboard::set_keys(uint16_t keys) { this->keys = keys; }
+uint16_t Keyboard::get_keys() { return this->keys; }
+
+bool Keyboard::is_pressed(uint8_t key) {
+  return key < Key::NONE && ((this->keys >> key) & 1) != 0;
+}
+
+Key Keyboard::get_pressed_key() {
+  if (this->keys == 0)
+    return Key::NONE;
+  return static_cast<Key>(__builtin_ctz(this->keys));
+}
@@ -1,6 +1,8 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+#include <cstdint>
+
 enum Key {
   ZERO,
   ONE,
@@ -21,13 +23,23 @@ enum Key {
   NONE
 };
 
+// The 16 key hex keypad as a bitmask, bit K is set while key K is held, so
+// any number of keys can be down at once and every query is a shift
 class Keyboard {
 public:
-  void set_pressed_key(Key key);
+  void press(Key key);
+  void release(Key key);
+  // Replace the whole state (replays and savestates)
+  void set_keys(uint16_t keys);
+  uint16_t get_keys();
+
+  // Whether key is held, values above 0xF (VX can hold any byte) never are
+  bool is_pressed(uint8_t key);
+  // Lowest held key, Key::NONE when nothing is held
   Key get_pressed_key();
 
 private:
-  Key pressed = Key::NONE;
+  uint16_t keys = 0;
 };
 
 #endif
@@ -0,0 +1,440 @@
+#include "lanes.hpp"
+#include "random.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+// Vectors only pass by reference here, returning them by value would tie the
+// helpers to the target's vector calling convention
+
+// dst = a on the lanes selected by mask
+inline void assign(LaneBytes &dst, const LaneByteMask &mask,
+                   const LaneBytes &a) {
+  dst = (LaneBytes)((mask & (LaneByteMask)a) | (~mask & (LaneByteMask)dst));
+}
+
+inline void assign(LaneWords &dst, const LaneWordMask &mask,
+                   const LaneWords &a) {
+  dst = (LaneWords)((mask & (LaneWordMask)a) | (~mask & (LaneWordMask)dst));
+}
+
+// Skip the next instruction on the lanes where condition holds
+inline void skip_if(LaneWords &PC, const LaneByteMask &condition) {
+  PC += (LaneWords)(__builtin_convertvector(condition, LaneWordMask) & 2);
+}
+} // namespace
+
+LaneEngine::LaneEngine(unsigned int lanes, QuirkProfile profile) {
+  this->lanes = std::min(std::max(lanes, 1u), LaneEngine::max_lanes);
+  this->profile = profile;
+  this->quirks = quirks_for(profile);
+
+  for (LaneBytes &v : this->V)
+    v = LaneBytes{};
+  for (LaneWords &s : this->stack)
+    s = LaneWords{};
+  this->I = LaneWords{};
+  this->PC = LaneWords{} + CHIP8::program_start_address;
+  this->opcode = LaneWords{};
+  this->SP = LaneBytes{};
+  this->DT = LaneBytes{};
+  this->ST = LaneBytes{};
+  this->keys = LaneWords{};
+
+  this->memory.assign(this->lanes * CHIP8::memory_size, 0);
+  this->framebuffers.assign(this->lanes * LaneEngine::display_height, 0);
+  for (unsigned int lane = 0; lane < this->lanes; lane++) {
+    std::copy(CHIP8::fontset.begin(), CHIP8::fontset.end(),
+              this->lane_memory(lane) + CHIP8::fontset_start_address);
+    this->seed_random(lane, CHIP8::default_seed);
+  }
+}
+
+bool LaneEngine::load_rom(const uint8_t *data, size_t size) {
+  if (size > CHIP8::max_rom_size) {
+    std::cerr << "[ERROR] Rom is " << size << " bytes, the program area only "
+              << "holds " << CHIP8::max_rom_size << std::endl;
+    return false;
+  }
+
+  for (unsigned int lane = 0; lane < this->lanes; lane++)
+    std::copy(data, data + size,
+              this->lane_memory(lane) + CHIP8::program_start_address);
+  return true;
+}
+
+void LaneEngine::seed_random(unsigned int lane, uint64_t seed) {
+  if (lane < this->lanes)
+    this->rng_state[lane] = random_state_from_seed(seed);
+}
+
+void LaneEngine::set_keys(unsigned int lane, uint16_t keys) {
+  if (lane < this->lanes)
+    this->keys[lane] = keys;
+}
+
+unsigned int LaneEngine::get_lanes() { return this->lanes; }
+
+QuirkProfile LaneEngine::get_quirks() { return this->profile; }
+
+const uint64_t *LaneEngine::get_framebuffers() {
+  return this->framebuffers.data();
+}
+
+uint8_t *LaneEngine::lane_memory(unsigned int lane) {
+  return &this->memory[lane * CHIP8::memory_size];
+}
+
+void LaneEngine::step_all(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++)
+    this->step();
+}
+
+void LaneEngine::tick_timers() {
+  this->DT -= (LaneBytes)(this->DT != 0) & 1;
+  this->ST -= (LaneBytes)(this->ST != 0) & 1;
+}
+
+void LaneEngine::step() {
+  // Fetch every running lane's instruction, lanes whose PC ran off the end of
+  // memory stop like CHIP8::step() does
+  uint32_t running = 0;
+  for (unsigned int lane = 0; lane < this->lanes; lane++) {
+    uint16_t pc = this->PC[lane];
+    if (pc >= 0xFFF)
+      continue;
+    const uint8_t *memory = this->lane_memory(lane);
+    this->opcode[lane] = (memory[pc] << 8) | memory[pc + 1];
+    running |= 1u << lane;
+  }
+
+  // Execute each distinct opcode once across all lanes that share it, in
+  // lockstep this is a single pass
+  uint32_t pending = running;
+  while (pending != 0) {
+    uint16_t op = this->opcode[__builtin_ctz(pending)];
+
+    uint32_t bits = 0;
+    LaneWordMask word_mask = LaneWordMask{};
+    for (uint32_t rest = pending; rest != 0; rest &= rest - 1) {
+      unsigned int lane = __builtin_ctz(rest);
+      if (this->opcode[lane] == op) {
+        bits |= 1u << lane;
+        word_mask[lane] = -1;
+      }
+    }
+    LaneByteMask mask = __builtin_convertvector(word_mask, LaneByteMask);
+
+    this->execute(op, mask, word_mask, bits);
+    pending &= ~bits;
+  }
+}
+
+void LaneEngine::execute(uint16_t opcode, const LaneByteMask &mask,
+                         const LaneWordMask &word_mask, uint32_t bits) {
+  uint8_t T = (opcode & 0xF000) >> 12;
+  uint8_t X = (opcode & 0x0F00) >> 8;
+  uint8_t Y = (opcode & 0x00F0) >> 4;
+  uint8_t N = opcode & 0x000F;
+  uint8_t NN = opcode & 0x00FF;
+  uint16_t NNN = opcode & 0x0FFF;
+
+  // Increment to next instruction
+  this->PC += (LaneWords)(word_mask & 2);
+
+  LaneBytes &VX = this->V[X];
+  LaneBytes VY = this->V[Y];
+  LaneBytes result;
+  LaneBytes flag;
+  bool sets_flag = false;
+
+  switch (T) {
+  case 0x0:
+    if (NN == 0xE0) { // 00E0 - CLS
+      for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+        unsigned int lane = __builtin_ctz(rest);
+        std::fill_n(&this->framebuffers[lane * LaneEngine::display_height],
+                    LaneEngine::display_height, 0);
+      }
+    } else if (NN == 0xEE) { // 00EE - RET
+      for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+        unsigned int lane = __builtin_ctz(rest);
+        this->PC[lane] = this->stack[this->SP[lane] & 0xF][lane];
+        this->SP[lane]--;
+      }
+    }
+    break;
+  case 0x1: // 1NNN - JP addr
+    assign(this->PC, word_mask, LaneWords{} + NNN);
+    break;
+  case 0x2: // 2NNN - CALL addr
+    for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+      unsigned int lane = __builtin_ctz(rest);
+      this->SP[lane]++;
+      this->stack[this->SP[lane] & 0xF][lane] = this->PC[lane];
+      this->PC[lane] = NNN;
+    }
+    break;
+  case 0x3: // 3XNN - SE VX, byte
+    skip_if(this->PC, mask & (VX == NN));
+    break;
+  case 0x4: // 4XNN - SNE VX, byte
+    skip_if(this->PC, mask & (VX != NN));
+    break;
+  case 0x5: // 5XY0 - SE VX, VY
+    skip_if(this->PC, mask & (VX == VY));
+    break;
+  case 0x6: // 6XNN - LD VX, byte
+    assign(VX, mask, LaneBytes{} + NN);
+    break;
+  case 0x7: // 7XNN - ADD VX, byte
+    VX += (LaneBytes)(mask & NN);
+    break;
+  case 0x8:
+    switch (N) {
+    case 0x0: // 8XY0 - LD VX, VY
+      assign(VX, mask, VY);
+      break;
+    case 0x1: // 8XY1 - OR VX, VY
+      assign(VX, mask, VX | VY);
+      if (this->quirks.reset_vf)
+        assign(this->V[0xF], mask, LaneBytes{});
+      break;
+    case 0x2: // 8XY2 - AND VX, VY
+      assign(VX, mask, VX & VY);
+      if (this->quirks.reset_vf)
+        assign(this->V[0xF], mask, LaneBytes{});
+      break;
+    case 0x3: // 8XY3 - XOR VX, VY
+      assign(VX, mask, VX ^ VY);
+      if (this->quirks.reset_vf)
+        assign(this->V[0xF], mask, LaneBytes{});
+      break;
+    case 0x4: // 8XY4 - ADD VX, VY
+      result = VX + VY;
+      flag = (LaneBytes)(result < VX) & 1;
+      sets_flag = true;
+      break;
+    case 0x5: // 8XY5 - SUB VX, VY
+      result = VX - VY;
+      flag = (LaneBytes)(VX >= VY) & 1;
+      sets_flag = true;
+      break;
+    case 0x6: // 8XY6 - SHR VX {, VY}
+      // With the shift_vy quirk VY is shifted into VX instead
+      result = this->quirks.shift_vy ? VY : VX;
+      flag = result & 1;
+      result >>= 1;
+      sets_flag = true;
+      break;
+    case 0x7: // 8XY7 - SUBN VX, VY
+      result = VY - VX;
+      flag = (LaneBytes)(VY >= VX) & 1;
+      sets_flag = true;
+      break;
+    case 0xE: // 8XYE - SHL VX {, VY}
+      result = this->quirks.shift_vy ? VY : VX;
+      flag = result >> 7;
+      result <<= 1;
+      sets_flag = true;
+      break;
+    default:
+      break;
+    }
+    // VF is written after VX so it wins when X is F
+    if (sets_flag) {
+      assign(VX, mask, result);
+      assign(this->V[0xF], mask, flag);
+    }
+    break;
+  case 0x9: // 9XY0 - SNE VX, VY
+    skip_if(this->PC, mask & (VX != VY));
+    break;
+  case 0xA: // ANNN - LD I, addr
+    assign(this->I, word_mask, LaneWords{} + NNN);
+    break;
+  case 0xB: // BNNN - JP V0, addr (XNN + VX with the jump_vx quirk)
+    assign(this->PC, word_mask,
+           __builtin_convertvector(this->V[this->quirks.jump_vx ? X : 0x0],
+                                   LaneWords) +
+               NNN);
+    break;
+  case 0xC: // CXNN - RND VX, byte
+    for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+      unsigned int lane = __builtin_ctz(rest);
+      VX[lane] = random_next_byte(this->rng_state[lane]) & NN;
+    }
+    break;
+  case 0xD: // DXYN - DRW VX, VY, nibble
+    for (uint32_t rest = bits; rest != 0; rest &= rest - 1)
+      this->draw_sprite(__builtin_ctz(rest), X, Y, N);
+    break;
+  case 0xE: {
+    // Bit VX of each lane's keys, VX above 0xF is never pressed
+    LaneWords key = __builtin_convertvector(VX, LaneWords);
+    LaneWordMask held = (key < 16) & (((this->keys >> (key & 15)) & 1) != 0);
+    LaneByteMask pressed = __builtin_convertvector(held, LaneByteMask);
+    if (NN == 0x9E) // EX9E - SKP VX
+      skip_if(this->PC, mask & pressed);
+    else if (NN == 0xA1) // EXA1 - SKNP VX
+      skip_if(this->PC, mask & ~pressed);
+    break;
+  }
+  case 0xF:
+    switch (NN) {
+    case 0x07: // FX07 - LD VX, DT
+      assign(VX, mask, this->DT);
+      break;
+    case 0x0A: // FX0A - LD VX, K
+      // Stay on this instruction until a key is pressed
+      for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+        unsigned int lane = __builtin_ctz(rest);
+        if (this->keys[lane] != 0)
+          VX[lane] = __builtin_ctz(this->keys[lane]);
+        else
+          this->PC[lane] -= 2;
+      }
+      break;
+    case 0x15: // FX15 - LD DT, VX
+      assign(this->DT, mask, VX);
+      break;
+    case 0x18: // FX18 - LD ST, VX
+      assign(this->ST, mask, VX);
+      break;
+    case 0x1E: // FX1E - ADD I, VX
+      this->I += (LaneWords)(word_mask &
+                             (LaneWordMask)__builtin_convertvector(VX, LaneWords));
+      break;
+    case 0x29: // FX29 - LD F, VX
+      for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+        unsigned int lane = __builtin_ctz(rest);
+        this->I[lane] = this->lane_memory(
+            lane)[CHIP8::fontset_start_address + 5 * VX[lane]];
+      }
+      break;
+    case 0x33: // FX33 - LD B, VX
+      for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+        unsigned int lane = __builtin_ctz(rest);
+        uint8_t *memory = this->lane_memory(lane);
+        uint16_t I = this->I[lane];
+        memory[I & (CHIP8::memory_size - 1)] = VX[lane] / 100;
+        memory[(I + 1) & (CHIP8::memory_size - 1)] = (VX[lane] % 100) / 10;
+        memory[(I + 2) & (CHIP8::memory_size - 1)] = VX[lane] % 10;
+      }
+      break;
+    case 0x55: // FX55 - LD [I], VX
+      for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+        unsigned int lane = __builtin_ctz(rest);
+        uint8_t *memory = this->lane_memory(lane);
+        for (int x = 0; x <= X; x++)
+          memory[(this->I[lane] + x) & (CHIP8::memory_size - 1)] =
+              this->V[x][lane];
+      }
+      this->advance_index(word_mask, X);
+      break;
+    case 0x65: // FX65 - LD VX, [I]
+      for (uint32_t rest = bits; rest != 0; rest &= rest - 1) {
+        unsigned int lane = __builtin_ctz(rest);
+        const uint8_t *memory = this->lane_memory(lane);
+        for (int x = 0; x <= X; x++)
+          this->V[x][lane] =
+              memory[(this->I[lane] + x) & (CHIP8::memory_size - 1)];
+      }
+      this->advance_index(word_mask, X);
+      break;
+    default:
+      break;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void LaneEngine::advance_index(const LaneWordMask &word_mask, uint8_t X) {
+  // Some interpreters leave I after the last register (or on it)
+  if (this->quirks.memory_index == ADVANCE_I_BY_X)
+    this->I += (LaneWords)(word_mask & static_cast<int16_t>(X));
+  else if (this->quirks.memory_index == ADVANCE_I_PAST_X)
+    this->I += (LaneWords)(word_mask & static_cast<int16_t>(X + 1));
+}
+
+void LaneEngine::draw_sprite(unsigned int lane, uint8_t X, uint8_t Y,
+                             uint8_t N) {
+  // Same order as CHIP8::draw_sprite: VF is reset before VX and VY are read
+  this->V[0xF][lane] = 0;
+  unsigned int x = this->V[X][lane] % LaneEngine::display_width;
+  unsigned int y = this->V[Y][lane] % LaneEngine::display_height;
+  const uint8_t *memory = this->lane_memory(lane);
+  uint64_t *rows = &this->framebuffers[lane * LaneEngine::display_height];
+
+  bool wrap = !this->quirks.clip_sprites;
+  bool collision = false;
+  for (unsigned int n = 0; n < N; n++) {
+    if (!wrap && y + n >= LaneEngine::display_height)
+      break;
+    uint64_t bits =
+        static_cast<uint64_t>(
+            memory[(this->I[lane] + n) & (CHIP8::memory_size - 1)])
+        << 56;
+    // The display is one word wide, wrapping is a rotate and clipping drops
+    // what is shifted out
+    if (x != 0)
+      bits = (bits >> x) | (wrap ? bits << (64 - x) : 0);
+    uint64_t &row = rows[(y + n) % LaneEngine::display_height];
+    collision |= (row & bits) != 0;
+    row ^= bits;
+  }
+
+  if (collision)
+    this->V[0xF][lane] = 1;
+}
+
+void LaneEngine::export_lane(unsigned int lane, CHIP8 &c8, Display &display) {
+  if (lane >= this->lanes)
+    return;
+
+  for (int x = 0; x < 16; x++) {
+    c8.V[x] = this->V[x][lane];
+    c8.stack[x] = this->stack[x][lane];
+  }
+  c8.I = this->I[lane];
+  c8.PC = this->PC[lane];
+  c8.opcode = this->opcode[lane];
+  c8.SP = this->SP[lane];
+  c8.DT = this->DT[lane];
+  c8.ST = this->ST[lane];
+  c8.rng_state = this->rng_state[lane];
+  std::memcpy(c8.memory.data(), this->lane_memory(lane), CHIP8::memory_size);
+  c8.invalidate_cache();
+  c8.keyboard->set_keys(this->keys[lane]);
+  display.load_buffer(&this->framebuffers[lane * LaneEngine::display_height],
+                      LaneEngine::display_height);
+}
+
+void LaneEngine::import_lane(unsigned int lane, CHIP8 &c8, Display &display) {
+  if (lane >= this->lanes)
+    return;
+
+  for (int x = 0; x < 16; x++) {
+    this->V[x][lane] = c8.V[x];
+    this->stack[x][lane] = c8.stack[x];
+  }
+  this->I[lane] = c8.I;
+  this->PC[lane] = c8.PC;
+  this->opcode[lane] = c8.opcode;
+  this->SP[lane] = c8.SP;
+  this->DT[lane] = c8.DT;
+  this->ST[lane] = c8.ST;
+  this->rng_state[lane] = c8.rng_state;
+  std::memcpy(this->lane_memory(lane), c8.memory.data(), CHIP8::memory_size);
+  this->keys[lane] = c8.keyboard->get_keys();
+
+  const std::vector<uint64_t> &buffer = display.get_buffer();
+  uint64_t *rows = &this->framebuffers[lane * LaneEngine::display_height];
+  std::fill_n(rows, LaneEngine::display_height, 0);
+  std::copy_n(buffer.begin(),
+              std::min<size_t>(buffer.size(), LaneEngine::display_height),
+              rows);
+}
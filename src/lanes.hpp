@@ -0,0 +1,91 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include "chip8.hpp"
+#include "display.hpp"
+#include "keyboard.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One byte or word per lane, operations on these compile to SSE/AVX2 vector
+// instructions depending on the target flags
+typedef uint8_t LaneBytes __attribute__((vector_size(32)));
+typedef int8_t LaneByteMask __attribute__((vector_size(32)));
+typedef uint16_t LaneWords __attribute__((vector_size(64)));
+typedef int16_t LaneWordMask __attribute__((vector_size(64)));
+
+// Struct-of-arrays interpreter that steps up to 32 CHIP-8 machines in
+// lockstep. Every register holds one element per lane, lanes executing the
+// same opcode run it together as vector operations under a lane mask and
+// diverging lanes are grouped by opcode and run one group after another.
+// Stack, memory, random and display accesses run per lane.
+//
+// Lanes behave exactly like CHIP8::step() with a 64x32 Display and the same
+// quirk profile. Every lane shares the profile, so its checks are the same
+// branch for the whole group.
+class LaneEngine {
+public:
+  static constexpr unsigned int max_lanes = 32;
+  static const unsigned int display_width = 64;
+  static const unsigned int display_height = 32;
+
+  explicit LaneEngine(unsigned int lanes = max_lanes,
+                      QuirkProfile profile = QUIRKS_DEFAULT);
+
+  // Load the same rom into every lane, returns false if it does not fit
+  bool load_rom(const uint8_t *data, size_t size);
+  void seed_random(unsigned int lane, uint64_t seed);
+  // Held keys of one lane as a Keyboard bitmask
+  void set_keys(unsigned int lane, uint16_t keys);
+
+  // Execute n instructions on every lane
+  void step_all(uint64_t n);
+  // Count every lane's delay and sound timers down by one
+  void tick_timers();
+
+  unsigned int get_lanes();
+  QuirkProfile get_quirks();
+  // Every lane's display rows back to back, lane l starts at
+  // l * display_height, one 64-bit word per row with the leftmost pixel in
+  // the most significant bit (the same layout as Display)
+  const uint64_t *get_framebuffers();
+
+  // Copy one lane's state into a scalar machine and its display, or load a
+  // lane from one
+  void export_lane(unsigned int lane, CHIP8 &c8, Display &display);
+  void import_lane(unsigned int lane, CHIP8 &c8, Display &display);
+
+  // Registers, element l belongs to lane l
+  LaneBytes V[16];
+  LaneWords I;
+  LaneWords PC;
+  LaneWords opcode;
+  LaneBytes SP;
+  LaneBytes DT;
+  LaneBytes ST;
+  LaneWords stack[16];
+
+private:
+  void step();
+  // Run one opcode on the lanes selected by the masks (bits has one bit per
+  // selected lane)
+  void execute(uint16_t opcode, const LaneByteMask &mask,
+               const LaneWordMask &word_mask, uint32_t bits);
+  // FX55 and FX65 on the selected lanes move I by the memory_index quirk
+  void advance_index(const LaneWordMask &word_mask, uint8_t X);
+  void draw_sprite(unsigned int lane, uint8_t X, uint8_t Y, uint8_t N);
+  uint8_t *lane_memory(unsigned int lane);
+
+  unsigned int lanes;
+  QuirkProfile profile;
+  Quirks quirks;
+  // Held keys of each lane, bit K set while key K is down
+  LaneWords keys;
+  uint64_t rng_state[max_lanes];
+  // Lane l's 4KB starts at l * CHIP8::memory_size
+  std::vector<uint8_t> memory;
+  std::vector<uint64_t> framebuffers;
+};
+
+#endif
@@ -1,18 +1,40 @@
 #include "backends/imgui_impl_sdl3.h"
 #include "backends/imgui_impl_sdlrenderer3.h"
+#include "audio_output.hpp"
 #include "chip8.hpp"
+#include "debugger_view.hpp"
 #include "display.hpp"
+#include "emulator_thread.hpp"
 #include "graphics.hpp"
 #include "imgui.h"
 #include "keyboard.hpp"
+#include "profile_view.hpp"
+#include "rom_library.hpp"
+#include "scheduler.hpp"
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #define DISPLAY_WIDTH 64
 #define DISPLAY_HEIGHT 32
 
+// SDL stamps events with its own nanosecond clock, carry the event's age
+// over to the steady clock the emulation thread uses
+static std::chrono::steady_clock::time_point
+key_time(const SDL_KeyboardEvent &key) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  Uint64 ticks = SDL_GetTicksNS();
+  if (key.timestamp == 0 || key.timestamp > ticks)
+    return now;
+  return now - std::chrono::nanoseconds(ticks - key.timestamp);
+}
+
 static const std::unordered_map<SDL_Keycode, Key> sdl_to_key{
     {SDLK_0, Key::ZERO},  {SDLK_1, Key::ONE},   {SDLK_2, Key::TWO},
     {SDLK_3, Key::THREE}, {SDLK_4, Key::FOUR},  {SDLK_5, Key::FIVE},
@@ -23,6 +45,78 @@ static const std::unordered_map<SDL_Keycode, Key> sdl_to_key{
 };
 
 int main(int argc, char **argv) {
+  const char *rom = nullptr;
+  EmulatorConfig config;
+  QuirkProfile quirks = QUIRKS_DEFAULT;
+  bool quirks_given = false;
+  unsigned int audio_buffer = AudioOutput::default_buffer_frames;
+  bool mute = false;
+  // Rom library the quirk profile comes from and last-run stats go to
+  const char *library_root = nullptr;
+  std::string index_path;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--hz") == 0 && i + 1 < argc) {
+      config.cpu_hz = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--turbo") == 0 && i + 1 < argc) {
+      config.turbo = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc) {
+      // Frames of input latency to hide
+      config.run_ahead = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--unthrottled") == 0) {
+      config.unthrottled = true;
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      config.seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      // Input log to write on exit, replay it with chip8_headless --replay
+      config.record_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+      if (!parse_quirk_profile(argv[++i], quirks)) {
+        SDL_Log("[ERROR] Unknown quirk profile: %s", argv[i]);
+        return 1;
+      }
+      quirks_given = true;
+    } else if (std::strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc) {
+      // Device buffer in samples, smaller is lower latency
+      audio_buffer = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--mute") == 0) {
+      mute = true;
+    } else if (std::strcmp(argv[i], "--library") == 0 && i + 1 < argc) {
+      library_root = argv[++i];
+    } else if (std::strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+      index_path = argv[++i];
+    } else if (argv[i][0] != '-' && rom == nullptr) {
+      rom = argv[i];
+    }
+  }
+
+  if (rom == nullptr) {
+    SDL_Log("Usage: %s <rom> [--hz N] [--turbo N] [--run-ahead N]"
+            " [--unthrottled] [--seed N] [--record FILE]"
+            " [--quirks default|vip|chip48|schip] [--audio-buffer N] [--mute]"
+            " [--library DIR [--index FILE]]",
+            argv[0]);
+    return 1;
+  }
+
+  // Scanning only stats the tree, roms are read again only when they changed
+  // since the index was saved
+  RomLibrary library;
+  RomEntry *entry = nullptr;
+  if (library_root != nullptr) {
+    if (index_path.empty())
+      index_path = std::string(library_root) + "/" +
+                   RomLibrary::default_index_name;
+    if (!library.load(index_path.c_str()))
+      return 1;
+    // Keep the hashing done even when the rom itself is not in the library
+    if (library.scan(library_root) > 0)
+      library.save(index_path.c_str());
+    entry = library.find(rom);
+    if (entry == nullptr)
+      SDL_Log("[INFO] %s is not in the library", rom);
+  }
+
   SDL sdl = init_sdl("CHIP-8", 1280, 640);
 
   ImGuiIO &io = ImGui::GetIO();
@@ -33,32 +127,97 @@ int main(int argc, char **argv) {
   Display display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
   Keyboard keyboard;
   CHIP8 c8(&display, &keyboard);
-  c8.load_rom(argv[1]);
+  if (quirks_given)
+    c8.set_quirks(quirks);
+  else if (entry != nullptr)
+    c8.set_quirks(entry->quirks);
+  else
+    c8.set_quirks(quirk_profile_for_rom(rom));
+  if (!c8.load_rom(rom)) {
+    shutdown_sdl(sdl);
+    return 1;
+  }
+
+  // F5 saves to and F9 loads from a file next to the rom, holding backspace
+  // steps back one frame per host frame (loading and rewinding are off while
+  // recording)
+  config.state_path = std::string(rom) + ".state";
+
+  // The emulation thread pushes the sound timer's edges, SDL's audio thread
+  // renders them
+  ToneSynth tone;
+  AudioOutput audio;
+  if (!mute && audio.open(&tone, audio_buffer))
+    config.tone = &tone;
+
+  // From here on the emulation thread owns c8, display and keyboard, this
+  // thread only sends it input and draws the frames it publishes
+  EmulatorThread emulator(&c8, config);
+  emulator.start();
+  auto session_start = std::chrono::steady_clock::now();
+  FramePacer pacer;
+
+  // One streaming texture for the whole session, rewritten in place only on
+  // frames where the display changed
+  SDL_Texture *texture =
+      SDL_CreateTexture(sdl.renderer, SDL_PIXELFORMAT_ARGB8888,
+                        SDL_TEXTUREACCESS_STREAMING, DISPLAY_WIDTH,
+                        DISPLAY_HEIGHT);
+  SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+  // Forces the first upload
+  emulator.update_frame();
+  uint64_t uploaded_generation = emulator.get_frame().generation - 1;
+
+  DebuggerView debugger_view;
 
-  SDL_Event event;
   bool quit = false;
-  while (!quit) {
-    // Non blocking polling for sdl2 events
-    // (e.g. key presses, x button to quit, etc)
-    while (SDL_PollEvent(&event)) {
-      ImGui_ImplSDL3_ProcessEvent(&event);
-      if (event.type == SDL_EVENT_QUIT ||
-          (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED &&
-           event.window.windowID == SDL_GetWindowID(sdl.window))) {
-        quit = true;
-      }
-      // Only send input to chip8 if imgui isn't capturing already
-      if (!ImGui::GetIO().WantCaptureKeyboard) {
-        if (event.type == SDL_EVENT_KEY_DOWN) {
-          if (sdl_to_key.count(event.key.key)) {
-            keyboard.set_pressed_key(sdl_to_key.at(event.key.key));
-            SDL_LogDebug(0, "[DEBUG] Key pressed: %c\n", event.key.key);
-          }
+  // Input, quit and hotkey handling for one SDL event
+  auto handle_event = [&](const SDL_Event &event) {
+    ImGui_ImplSDL3_ProcessEvent(&event);
+    if (event.type == SDL_EVENT_QUIT ||
+        (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED &&
+         event.window.windowID == SDL_GetWindowID(sdl.window))) {
+      quit = true;
+    }
+    // Only send input to chip8 if imgui isn't capturing already
+    if (!ImGui::GetIO().WantCaptureKeyboard) {
+      // Each key goes down and up on its own so several can be held, key
+      // repeats change nothing
+      if ((event.type == SDL_EVENT_KEY_DOWN && !event.key.repeat) ||
+          event.type == SDL_EVENT_KEY_UP) {
+        auto key = sdl_to_key.find(event.key.key);
+        if (key != sdl_to_key.end()) {
+          bool down = event.type == SDL_EVENT_KEY_DOWN;
+          emulator.send({down ? EmulatorInput::KEY_DOWN : EmulatorInput::KEY_UP,
+                         key->second, key_time(event.key)});
+          SDL_LogDebug(0, "[DEBUG] Key %s: %c\n", down ? "pressed" : "released",
+                       event.key.key);
         }
-        if (event.type == SDL_EVENT_KEY_UP)
-          keyboard.set_pressed_key(Key::NONE);
       }
+
+      if (event.type == SDL_EVENT_KEY_DOWN && !event.key.repeat) {
+        if (event.key.key == SDLK_F5)
+          emulator.send({EmulatorInput::SAVE_STATE});
+        else if (event.key.key == SDLK_F9)
+          emulator.send({EmulatorInput::LOAD_STATE});
+        else if (event.key.key == SDLK_BACKSPACE)
+          emulator.send({EmulatorInput::REWIND_START});
+      }
+      if (event.type == SDL_EVENT_KEY_UP && event.key.key == SDLK_BACKSPACE)
+        emulator.send({EmulatorInput::REWIND_STOP});
     }
+  };
+
+  SDL_Event event;
+  while (!quit) {
+    // Non blocking polling for sdl2 events
+    // (e.g. key presses, x button to quit, etc)
+    while (SDL_PollEvent(&event))
+      handle_event(event);
+    // Pick up the newest emulated frame, if the emulation thread published
+    // several since the last host frame the older ones are skipped
+    emulator.update_frame();
+    const EmulatorFrame &frame = emulator.get_frame();
 
     ImGui_ImplSDLRenderer3_NewFrame();
     ImGui_ImplSDL3_NewFrame();
@@ -75,66 +234,108 @@ int main(int argc, char **argv) {
             ImGui::TableSetupColumn("Register");
             ImGui::TableSetupColumn("Value");
             ImGui::TableHeadersRow();
-            for (int row = 0; row < c8.V.size(); row++) {
+            for (int row = 0; row < frame.V.size(); row++) {
               ImGui::TableNextRow();
               ImGui::TableNextColumn();
               ImGui::Text("V%X", row);
               ImGui::TableNextColumn();
-              ImGui::Text("0x%X", c8.V[row]);
+              ImGui::Text("0x%X", frame.V[row]);
             }
           }
           ImGui::EndTable();
 
-          ImGui::Text("Opcode: 0x%x", c8.opcode);
-          ImGui::Text("PC: 0x%x", c8.PC);
-          ImGui::Text("SP: 0x%x", c8.SP);
-          ImGui::Text("I: 0x%x", c8.I);
-          ImGui::Text("DT: 0x%x", c8.DT);
-          ImGui::Text("ST: 0x%x", c8.ST);
+          ImGui::Text("Opcode: 0x%x", frame.opcode);
+          ImGui::Text("PC: 0x%x", frame.PC);
+          ImGui::Text("SP: 0x%x", frame.SP);
+          ImGui::Text("I: 0x%x", frame.I);
+          ImGui::Text("DT: 0x%x", frame.DT);
+          ImGui::Text("ST: 0x%x", frame.ST);
+          ImGui::Text("Cycles: %llu", (unsigned long long)frame.cycles);
+          ImGui::Text("Frames: %llu", (unsigned long long)frame.frames);
+          ImGui::Text("Rewind: %zu frames (%zu KB)", frame.rewind_frames,
+                      frame.rewind_bytes / 1024);
+          if (frame.waiting_for_key)
+            ImGui::Text("Waiting for key");
         }
         if (ImGui::CollapsingHeader("Display")) {
         }
+        if (ImGui::CollapsingHeader("Debugger"))
+          debugger_view.draw(frame, emulator);
+#ifdef CHIP8_PROFILE
+        if (ImGui::CollapsingHeader("Profile") && draw_profile(frame.profile))
+          emulator.send({EmulatorInput::RESET_PROFILE});
+#endif
         if (ImGui::CollapsingHeader("Keyboard")) {
-          ImGui::Text("Pressed: %3x", keyboard.get_pressed_key());
+          // Held keys as hex digits, '.' for the others
+          char held[17] = {};
+          for (int key = 0; key < 16; key++)
+            held[key] = (frame.keys >> key) & 1 ? "0123456789ABCDEF"[key] : '.';
+          ImGui::Text("Pressed: %s", held);
         }
       }
 
       ImGui::End();
     }
 
-    // Convert chip8 display pixels to sdl rectangles
-    auto display_buffer = display.get_buffer();
-    // Collect rectangles to be drawn
-    std::vector<uint32_t> pixels(display_buffer.size(), 0);
-    // Convert true to white and false to black
-    std::transform(
-        display_buffer.cbegin(), display_buffer.cend(), pixels.begin(),
-        [](bool state) -> uint32_t { return state ? 0xFFFFFFFF : 0xFF000000; });
-
+    // Only convert and upload the display when its pixels changed
+    if (frame.generation != uploaded_generation) {
+      const std::vector<uint64_t> &display_buffer = frame.pixels;
+      unsigned int words_per_row = frame.words_per_row;
+      void *locked;
+      int pitch;
+      if (SDL_LockTexture(texture, nullptr, &locked, &pitch)) {
+        // Convert lit pixels to white and unlit pixels to black
+        for (unsigned int y = 0; y < DISPLAY_HEIGHT; y++) {
+          uint32_t *pixels = reinterpret_cast<uint32_t *>(
+              static_cast<uint8_t *>(locked) + y * pitch);
+          for (unsigned int x = 0; x < DISPLAY_WIDTH; x++) {
+            uint64_t word = display_buffer[y * words_per_row + x / 64];
+            bool state = (word >> (63 - x % 64)) & 0b1;
+            pixels[x] = state ? 0xFFFFFFFF : 0xFF000000;
+          }
+        }
+        SDL_UnlockTexture(texture);
+        uploaded_generation = frame.generation;
+      }
+    }
 
     // Clear old pixels
     SDL_SetRenderDrawColor(sdl.renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
     SDL_RenderClear(sdl.renderer);
 
-    // Turn pixel color data into a texture that fills the entire renderer
-    auto texture = SDL_CreateTexture(sdl.renderer, SDL_PIXELFORMAT_ARGB8888,
-                                     SDL_TEXTUREACCESS_STATIC, DISPLAY_WIDTH,
-                                     DISPLAY_HEIGHT);
-    SDL_UpdateTexture(texture, nullptr, pixels.data(), DISPLAY_WIDTH * 4);
-    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+    // Stretch the display texture over the entire renderer
     SDL_RenderTexture(sdl.renderer, texture, nullptr, nullptr);
 
     ImGui::Render();
     ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), sdl.renderer);
     SDL_RenderPresent(sdl.renderer);
 
-    SDL_DestroyTexture(texture);
-
-    // Interpret next instruction from rom
-    c8.step();
+    // Sleep until the next frame is due, waking for input so it reaches the
+    // emulation thread as soon as it arrives
+    while (!quit) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          pacer.remaining());
+      if (remaining.count() <= 0 ||
+          !SDL_WaitEventTimeout(&event, remaining.count()))
+        break;
+      handle_event(event);
+    }
+    pacer.wait();
   }
 
+  emulator.stop();
+  audio.close();
+  if (entry != nullptr) {
+    // The emulation thread is gone, the display is ours again
+    emulator.update_frame();
+    std::chrono::duration<double> session =
+        std::chrono::steady_clock::now() - session_start;
+    library.record_run(*entry, emulator.get_frame().cycles, display.hash(),
+                       session.count());
+    library.save(index_path.c_str());
+  }
   SDL_LogInfo(0, "[INFO] Quitting...\n");
+  SDL_DestroyTexture(texture);
   shutdown_sdl(sdl);
   return 0;
 }
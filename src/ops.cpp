@@ -0,0 +1,333 @@
+#include "ops.hpp"
+#include "chip8.hpp"
+#include "keyboard.hpp"
+
+// Handlers mirror the reference switch in CHIP8::interpret(), see there for
+// the details of each instruction
+
+template <QuirkProfile P> static Instruction decode_for(uint16_t opcode) {
+  Instruction ins;
+  ins.opcode = opcode;
+  ins.NNN = opcode & 0x0FFF;
+  ins.X = (opcode & 0x0F00) >> 8;
+  ins.Y = (opcode & 0x00F0) >> 4;
+  ins.N = opcode & 0x000F;
+  ins.NN = opcode & 0x00FF;
+  ins.handler = ops::op_NOP;
+
+  switch ((opcode & 0xF000) >> 12) {
+  case 0x0:
+    if (ins.NN == 0xE0)
+      ins.handler = ops::op_00E0;
+    else if (ins.NN == 0xEE)
+      ins.handler = ops::op_00EE;
+    break;
+  case 0x1:
+    ins.handler = ops::op_1NNN;
+    break;
+  case 0x2:
+    ins.handler = ops::op_2NNN;
+    break;
+  case 0x3:
+    ins.handler = ops::op_3XNN;
+    break;
+  case 0x4:
+    ins.handler = ops::op_4XNN;
+    break;
+  case 0x5:
+    ins.handler = ops::op_5XY0;
+    break;
+  case 0x6:
+    ins.handler = ops::op_6XNN;
+    break;
+  case 0x7:
+    ins.handler = ops::op_7XNN;
+    break;
+  case 0x8:
+    switch (ins.N) {
+    case 0x0:
+      ins.handler = ops::op_8XY0;
+      break;
+    case 0x1:
+      ins.handler = ops::op_8XY1<P>;
+      break;
+    case 0x2:
+      ins.handler = ops::op_8XY2<P>;
+      break;
+    case 0x3:
+      ins.handler = ops::op_8XY3<P>;
+      break;
+    case 0x4:
+      ins.handler = ops::op_8XY4;
+      break;
+    case 0x5:
+      ins.handler = ops::op_8XY5;
+      break;
+    case 0x6:
+      ins.handler = ops::op_8XY6<P>;
+      break;
+    case 0x7:
+      ins.handler = ops::op_8XY7;
+      break;
+    case 0xE:
+      ins.handler = ops::op_8XYE<P>;
+      break;
+    default:
+      break;
+    }
+    break;
+  case 0x9:
+    ins.handler = ops::op_9XY0;
+    break;
+  case 0xA:
+    ins.handler = ops::op_ANNN;
+    break;
+  case 0xB:
+    ins.handler = ops::op_BNNN<P>;
+    break;
+  case 0xC:
+    ins.handler = ops::op_CXNN;
+    break;
+  case 0xD:
+    ins.handler = ops::op_DXYN<P>;
+    break;
+  case 0xE:
+    if (ins.NN == 0x9E)
+      ins.handler = ops::op_EX9E;
+    else if (ins.NN == 0xA1)
+      ins.handler = ops::op_EXA1;
+    break;
+  case 0xF:
+    switch (ins.NN) {
+    case 0x07:
+      ins.handler = ops::op_FX07;
+      break;
+    case 0x0A:
+      ins.handler = ops::op_FX0A;
+      break;
+    case 0x15:
+      ins.handler = ops::op_FX15;
+      break;
+    case 0x18:
+      ins.handler = ops::op_FX18;
+      break;
+    case 0x1E:
+      ins.handler = ops::op_FX1E;
+      break;
+    case 0x29:
+      ins.handler = ops::op_FX29;
+      break;
+    case 0x33:
+      ins.handler = ops::op_FX33;
+      break;
+    case 0x55:
+      ins.handler = ops::op_FX55<P>;
+      break;
+    case 0x65:
+      ins.handler = ops::op_FX65<P>;
+      break;
+    default:
+      break;
+    }
+    break;
+  }
+
+  return ins;
+}
+
+Instruction ops::decode(uint16_t opcode, QuirkProfile profile) {
+  switch (profile) {
+  case QUIRKS_VIP:
+    return decode_for<QUIRKS_VIP>(opcode);
+  case QUIRKS_CHIP48:
+    return decode_for<QUIRKS_CHIP48>(opcode);
+  case QUIRKS_SCHIP:
+    return decode_for<QUIRKS_SCHIP>(opcode);
+  default:
+    return decode_for<QUIRKS_DEFAULT>(opcode);
+  }
+}
+
+void ops::decode_and_execute(CHIP8 &c8, const Instruction &) {
+  uint16_t address = c8.PC - 2;
+  c8.opcode = (c8.memory[address] << 8) | c8.memory[address + 1];
+  Instruction &cached = c8.decode_cache[address];
+  cached = ops::decode(c8.opcode, c8.quirk_profile);
+  cached.handler(c8, cached);
+}
+
+void ops::op_NOP(CHIP8 &, const Instruction &) {}
+
+void ops::op_00E0(CHIP8 &c8, const Instruction &) {
+  c8.display->clear_buffer();
+}
+
+void ops::op_00EE(CHIP8 &c8, const Instruction &) {
+  c8.PC = c8.stack[c8.SP--];
+}
+
+void ops::op_1NNN(CHIP8 &c8, const Instruction &ins) { c8.PC = ins.NNN; }
+
+void ops::op_2NNN(CHIP8 &c8, const Instruction &ins) {
+  c8.stack[++c8.SP] = c8.PC;
+  c8.PC = ins.NNN;
+}
+
+void ops::op_3XNN(CHIP8 &c8, const Instruction &ins) {
+  if (c8.V[ins.X] == ins.NN)
+    c8.PC += 2;
+}
+
+void ops::op_4XNN(CHIP8 &c8, const Instruction &ins) {
+  if (c8.V[ins.X] != ins.NN)
+    c8.PC += 2;
+}
+
+void ops::op_5XY0(CHIP8 &c8, const Instruction &ins) {
+  if (c8.V[ins.X] == c8.V[ins.Y])
+    c8.PC += 2;
+}
+
+void ops::op_6XNN(CHIP8 &c8, const Instruction &ins) { c8.V[ins.X] = ins.NN; }
+
+void ops::op_7XNN(CHIP8 &c8, const Instruction &ins) {
+  c8.V[ins.X] += ins.NN;
+}
+
+void ops::op_8XY0(CHIP8 &c8, const Instruction &ins) {
+  c8.V[ins.X] = c8.V[ins.Y];
+}
+
+template <QuirkProfile P>
+void ops::op_8XY1(CHIP8 &c8, const Instruction &ins) {
+  c8.V[ins.X] |= c8.V[ins.Y];
+  if constexpr (quirks_for(P).reset_vf)
+    c8.V[0xF] = 0;
+}
+
+template <QuirkProfile P>
+void ops::op_8XY2(CHIP8 &c8, const Instruction &ins) {
+  c8.V[ins.X] &= c8.V[ins.Y];
+  if constexpr (quirks_for(P).reset_vf)
+    c8.V[0xF] = 0;
+}
+
+template <QuirkProfile P>
+void ops::op_8XY3(CHIP8 &c8, const Instruction &ins) {
+  c8.V[ins.X] ^= c8.V[ins.Y];
+  if constexpr (quirks_for(P).reset_vf)
+    c8.V[0xF] = 0;
+}
+
+void ops::op_8XY4(CHIP8 &c8, const Instruction &ins) {
+  uint8_t flag = c8.V[ins.X] + c8.V[ins.Y] > 0xFF ? 1 : 0;
+  c8.V[ins.X] += c8.V[ins.Y];
+  c8.V[0xF] = flag;
+}
+
+void ops::op_8XY5(CHIP8 &c8, const Instruction &ins) {
+  uint8_t flag = c8.V[ins.X] >= c8.V[ins.Y] ? 1 : 0;
+  c8.V[ins.X] -= c8.V[ins.Y];
+  c8.V[0xF] = flag;
+}
+
+template <QuirkProfile P>
+void ops::op_8XY6(CHIP8 &c8, const Instruction &ins) {
+  uint8_t source = c8.V[quirks_for(P).shift_vy ? ins.Y : ins.X];
+  c8.V[ins.X] = source >> 1;
+  c8.V[0xF] = source & 0b1;
+}
+
+void ops::op_8XY7(CHIP8 &c8, const Instruction &ins) {
+  uint8_t flag = c8.V[ins.Y] >= c8.V[ins.X] ? 1 : 0;
+  c8.V[ins.X] = c8.V[ins.Y] - c8.V[ins.X];
+  c8.V[0xF] = flag;
+}
+
+template <QuirkProfile P>
+void ops::op_8XYE(CHIP8 &c8, const Instruction &ins) {
+  uint8_t source = c8.V[quirks_for(P).shift_vy ? ins.Y : ins.X];
+  c8.V[ins.X] = source << 1;
+  c8.V[0xF] = (source >> 7) & 0b1;
+}
+
+void ops::op_9XY0(CHIP8 &c8, const Instruction &ins) {
+  if (c8.V[ins.X] != c8.V[ins.Y])
+    c8.PC += 2;
+}
+
+void ops::op_ANNN(CHIP8 &c8, const Instruction &ins) { c8.I = ins.NNN; }
+
+template <QuirkProfile P>
+void ops::op_BNNN(CHIP8 &c8, const Instruction &ins) {
+  c8.PC = ins.NNN + c8.V[quirks_for(P).jump_vx ? ins.X : 0x0];
+}
+
+void ops::op_CXNN(CHIP8 &c8, const Instruction &ins) {
+  c8.V[ins.X] = c8.random_byte() & ins.NN;
+}
+
+template <QuirkProfile P>
+void ops::op_DXYN(CHIP8 &c8, const Instruction &ins) {
+  c8.draw_sprite(ins.X, ins.Y, ins.N, !quirks_for(P).clip_sprites);
+}
+
+void ops::op_EX9E(CHIP8 &c8, const Instruction &ins) {
+  if (c8.keyboard->is_pressed(c8.V[ins.X]))
+    c8.PC += 2;
+}
+
+void ops::op_EXA1(CHIP8 &c8, const Instruction &ins) {
+  if (!c8.keyboard->is_pressed(c8.V[ins.X]))
+    c8.PC += 2;
+}
+
+void ops::op_FX07(CHIP8 &c8, const Instruction &ins) { c8.V[ins.X] = c8.DT; }
+
+void ops::op_FX0A(CHIP8 &c8, const Instruction &ins) {
+  Key pressed_key = c8.keyboard->get_pressed_key();
+  if (pressed_key != Key::NONE)
+    c8.V[ins.X] = pressed_key;
+  else
+    c8.PC -= 2;
+}
+
+void ops::op_FX15(CHIP8 &c8, const Instruction &ins) { c8.DT = c8.V[ins.X]; }
+
+void ops::op_FX18(CHIP8 &c8, const Instruction &ins) {
+  c8.set_sound_timer(c8.V[ins.X]);
+}
+
+void ops::op_FX1E(CHIP8 &c8, const Instruction &ins) { c8.I += c8.V[ins.X]; }
+
+void ops::op_FX29(CHIP8 &c8, const Instruction &ins) {
+  c8.I = c8.memory[CHIP8::fontset_start_address + 5 * c8.V[ins.X]];
+}
+
+void ops::op_FX33(CHIP8 &c8, const Instruction &ins) {
+  c8.write_memory(c8.I, c8.V[ins.X] / 100);
+  c8.write_memory(c8.I + 1, (c8.V[ins.X] % 100) / 10);
+  c8.write_memory(c8.I + 2, c8.V[ins.X] % 10);
+}
+
+// Where FX55 and FX65 leave I under a profile
+template <QuirkProfile P> static void advance_i(CHIP8 &c8, uint8_t X) {
+  if constexpr (quirks_for(P).memory_index == ADVANCE_I_BY_X)
+    c8.I += X;
+  else if constexpr (quirks_for(P).memory_index == ADVANCE_I_PAST_X)
+    c8.I += X + 1;
+}
+
+template <QuirkProfile P>
+void ops::op_FX55(CHIP8 &c8, const Instruction &ins) {
+  for (int x = 0; x <= ins.X; x++)
+    c8.write_memory(c8.I + x, c8.V[x]);
+  advance_i<P>(c8, ins.X);
+}
+
+template <QuirkProfile P>
+void ops::op_FX65(CHIP8 &c8, const Instruction &ins) {
+  for (int x = 0; x <= ins.X; x++)
+    c8.V[x] = c8.memory[c8.I + x];
+  advance_i<P>(c8, ins.X);
+}
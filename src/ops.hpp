@@ -0,0 +1,80 @@
+#ifndef OPS_H
+#define OPS_H
+
+#include "quirks.hpp"
+#include <cstdint>
+
+class CHIP8;
+struct Instruction;
+
+// Executes one decoded instruction. PC already points at the next one.
+typedef void (*Handler)(CHIP8 &c8, const Instruction &ins);
+
+// An opcode decoded once into its handler and operands
+struct Instruction {
+  Handler handler;
+  uint16_t opcode;
+  uint16_t NNN; // memory address
+  uint8_t X;    // register
+  uint8_t Y;    // register
+  uint8_t N;    // nibble
+  uint8_t NN;   // byte
+};
+
+namespace ops {
+// Split an opcode into its operands and pick the handler that executes it,
+// instructions with quirks get the handler instantiated for the profile
+Instruction decode(uint16_t opcode, QuirkProfile profile = QUIRKS_DEFAULT);
+
+// Placeholder handler for addresses that have not been decoded yet: decodes
+// the instruction at PC - 2 for the CHIP8's quirk profile, caches it and
+// executes it
+void decode_and_execute(CHIP8 &c8, const Instruction &ins);
+
+void op_NOP(CHIP8 &c8, const Instruction &ins);
+void op_00E0(CHIP8 &c8, const Instruction &ins);
+void op_00EE(CHIP8 &c8, const Instruction &ins);
+void op_1NNN(CHIP8 &c8, const Instruction &ins);
+void op_2NNN(CHIP8 &c8, const Instruction &ins);
+void op_3XNN(CHIP8 &c8, const Instruction &ins);
+void op_4XNN(CHIP8 &c8, const Instruction &ins);
+void op_5XY0(CHIP8 &c8, const Instruction &ins);
+void op_6XNN(CHIP8 &c8, const Instruction &ins);
+void op_7XNN(CHIP8 &c8, const Instruction &ins);
+void op_8XY0(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_8XY1(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_8XY2(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_8XY3(CHIP8 &c8, const Instruction &ins);
+void op_8XY4(CHIP8 &c8, const Instruction &ins);
+void op_8XY5(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_8XY6(CHIP8 &c8, const Instruction &ins);
+void op_8XY7(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_8XYE(CHIP8 &c8, const Instruction &ins);
+void op_9XY0(CHIP8 &c8, const Instruction &ins);
+void op_ANNN(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_BNNN(CHIP8 &c8, const Instruction &ins);
+void op_CXNN(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_DXYN(CHIP8 &c8, const Instruction &ins);
+void op_EX9E(CHIP8 &c8, const Instruction &ins);
+void op_EXA1(CHIP8 &c8, const Instruction &ins);
+void op_FX07(CHIP8 &c8, const Instruction &ins);
+void op_FX0A(CHIP8 &c8, const Instruction &ins);
+void op_FX15(CHIP8 &c8, const Instruction &ins);
+void op_FX18(CHIP8 &c8, const Instruction &ins);
+void op_FX1E(CHIP8 &c8, const Instruction &ins);
+void op_FX29(CHIP8 &c8, const Instruction &ins);
+void op_FX33(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_FX55(CHIP8 &c8, const Instruction &ins);
+template <QuirkProfile P>
+void op_FX65(CHIP8 &c8, const Instruction &ins);
+} // namespace ops
+
+#endif
@@ -0,0 +1,162 @@
+#include "profile.hpp"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static const char *const family_names[Profile::family_count] = {
+    "00E0", "00EE", "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN",
+    "7XNN", "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7",
+    "8XYE", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "FX07",
+    "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65", "invalid"};
+
+static const unsigned int invalid_family = Profile::family_count - 1;
+
+unsigned int Profile::family(uint16_t opcode) {
+  uint8_t T = opcode >> 12;
+  uint8_t N = opcode & 0x000F;
+  uint8_t NN = opcode & 0x00FF;
+
+  switch (T) {
+  case 0x0:
+    return opcode == 0x00E0 ? 0 : opcode == 0x00EE ? 1 : 2;
+  case 0x8:
+    if (N <= 0x7)
+      return 10 + N;
+    return N == 0xE ? 18 : invalid_family;
+  case 0xE:
+    return NN == 0x9E ? 24 : NN == 0xA1 ? 25 : invalid_family;
+  case 0xF:
+    switch (NN) {
+    case 0x07:
+      return 26;
+    case 0x0A:
+      return 27;
+    case 0x15:
+      return 28;
+    case 0x18:
+      return 29;
+    case 0x1E:
+      return 30;
+    case 0x29:
+      return 31;
+    case 0x33:
+      return 32;
+    case 0x55:
+      return 33;
+    case 0x65:
+      return 34;
+    default:
+      return invalid_family;
+    }
+  case 0x9:
+    return 19;
+  default:
+    // 1NNN through 7XNN and ANNN through DXYN are one family each
+    return T < 0x9 ? T + 2 : T + 10;
+  }
+}
+
+const char *Profile::family_name(unsigned int family) {
+  return family < Profile::family_count ? family_names[family] : "invalid";
+}
+
+bool Profile::is_skip(unsigned int family) {
+  // 3XNN, 4XNN, 5XY0, 9XY0, EX9E and EXA1
+  return (family >= 5 && family <= 7) || family == 19 || family == 24 ||
+         family == 25;
+}
+
+void Profile::reset() { *this = Profile(); }
+
+bool Profile::write(const char *filename) {
+  size_t length = std::strlen(filename);
+  if (length >= 5 && std::strcmp(filename + length - 5, ".json") == 0)
+    return this->write_json(filename);
+  return this->write_csv(filename);
+}
+
+bool Profile::write_json(const char *filename) {
+  FILE *file = std::fopen(filename, "w");
+  if (file == nullptr) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+
+  std::fprintf(file, "{\n  \"instructions\": %llu,\n",
+               (unsigned long long)this->instructions);
+  std::fprintf(file, "  \"families\": {");
+  for (unsigned int f = 0; f < Profile::family_count; f++)
+    std::fprintf(file, "%s\"%s\": %llu", f ? ", " : "", family_names[f],
+                 (unsigned long long)this->family_counts[f]);
+  std::fprintf(file, "},\n");
+  std::fprintf(file,
+               "  \"skips\": {\"taken\": %llu, \"not_taken\": %llu},\n"
+               "  \"sprites\": {\"draws\": %llu, \"rows\": %llu, "
+               "\"collisions\": %llu},\n",
+               (unsigned long long)this->skips_taken,
+               (unsigned long long)this->skips_not_taken,
+               (unsigned long long)this->sprites,
+               (unsigned long long)this->sprite_rows,
+               (unsigned long long)this->collisions);
+
+  // Oldest recorded frame first
+  std::fprintf(file, "  \"frames\": %llu,\n  \"frame_cycles\": [",
+               (unsigned long long)this->frames);
+  uint64_t first = this->frames > Profile::frame_history
+                       ? this->frames - Profile::frame_history
+                       : 0;
+  for (uint64_t f = first; f < this->frames; f++)
+    std::fprintf(file, "%s%u", f > first ? ", " : "",
+                 this->frame_cycles[f % Profile::frame_history]);
+  std::fprintf(file, "],\n");
+
+  // Only addresses that were executed
+  std::fprintf(file, "  \"pc_hits\": {");
+  bool first_hit = true;
+  for (unsigned int pc = 0; pc < Profile::memory_size; pc++) {
+    if (this->pc_hits[pc] == 0)
+      continue;
+    std::fprintf(file, "%s\"0x%03X\": %llu", first_hit ? "" : ", ", pc,
+                 (unsigned long long)this->pc_hits[pc]);
+    first_hit = false;
+  }
+  std::fprintf(file, "}\n}\n");
+
+  return std::fclose(file) == 0;
+}
+
+bool Profile::write_csv(const char *filename) {
+  FILE *file = std::fopen(filename, "w");
+  if (file == nullptr) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+
+  // One kind,key,count record per counter
+  std::fprintf(file, "kind,key,count\n");
+  std::fprintf(file, "total,instructions,%llu\n",
+               (unsigned long long)this->instructions);
+  for (unsigned int f = 0; f < Profile::family_count; f++)
+    std::fprintf(file, "family,%s,%llu\n", family_names[f],
+                 (unsigned long long)this->family_counts[f]);
+  std::fprintf(file, "skip,taken,%llu\nskip,not_taken,%llu\n",
+               (unsigned long long)this->skips_taken,
+               (unsigned long long)this->skips_not_taken);
+  std::fprintf(file, "sprite,draws,%llu\nsprite,rows,%llu\n"
+                     "sprite,collisions,%llu\n",
+               (unsigned long long)this->sprites,
+               (unsigned long long)this->sprite_rows,
+               (unsigned long long)this->collisions);
+  uint64_t first = this->frames > Profile::frame_history
+                       ? this->frames - Profile::frame_history
+                       : 0;
+  for (uint64_t f = first; f < this->frames; f++)
+    std::fprintf(file, "frame,%llu,%u\n", (unsigned long long)f,
+                 this->frame_cycles[f % Profile::frame_history]);
+  for (unsigned int pc = 0; pc < Profile::memory_size; pc++)
+    if (this->pc_hits[pc] != 0)
+      std::fprintf(file, "pc,0x%03X,%llu\n", pc,
+                   (unsigned long long)this->pc_hits[pc]);
+
+  return std::fclose(file) == 0;
+}
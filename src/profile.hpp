@@ -0,0 +1,83 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Statements wrapped in PROFILE_HOOK only exist in builds configured with
+// -DCHIP8_PROFILE=ON, other builds compile them out entirely
+#ifdef CHIP8_PROFILE
+#define PROFILE_HOOK(statement) statement
+#else
+#define PROFILE_HOOK(statement)
+#endif
+
+// Execution statistics of one CHIP8, filled in by the interpreter and cached
+// engines (profiling builds run JIT requests on the cached engine since
+// translated code has no hooks)
+class Profile {
+public:
+  // Instruction families, one per row of the instruction set plus invalid
+  static const unsigned int family_count = 36;
+  static const unsigned int memory_size = 4096;
+  // Number of recent frames kept in frame_cycles
+  static const unsigned int frame_history = 240;
+
+  static unsigned int family(uint16_t opcode);
+  static const char *family_name(unsigned int family);
+
+  // Called after every instruction with PC before and after it ran, a skip
+  // was taken when PC moved past the next instruction
+  void executed(uint16_t pc, uint16_t opcode, uint16_t next_pc) {
+    unsigned int f = Profile::family(opcode);
+    this->family_counts[f]++;
+    this->pc_hits[pc & (Profile::memory_size - 1)]++;
+    this->instructions++;
+    this->frame_instructions++;
+    if (Profile::is_skip(f)) {
+      if (next_pc == static_cast<uint16_t>(pc + 4))
+        this->skips_taken++;
+      else
+        this->skips_not_taken++;
+    }
+  }
+  void sprite(unsigned int rows, bool collision) {
+    this->sprites++;
+    this->sprite_rows += rows;
+    this->collisions += collision;
+  }
+  // Called at every 60Hz timer tick, closes the current frame
+  void frame() {
+    this->frame_cycles[this->frames % Profile::frame_history] =
+        this->frame_instructions;
+    this->frames++;
+    this->frame_instructions = 0;
+  }
+
+  void reset();
+  // Write every counter, the format is picked by the extension (.json or
+  // anything else for CSV)
+  bool write(const char *filename);
+
+  std::array<uint64_t, family_count> family_counts{};
+  std::array<uint64_t, memory_size> pc_hits{};
+  uint64_t instructions = 0;
+  uint64_t skips_taken = 0;
+  uint64_t skips_not_taken = 0;
+  uint64_t sprites = 0;
+  uint64_t sprite_rows = 0;
+  uint64_t collisions = 0;
+  // Instructions executed in each of the last frame_history frames, frame f
+  // is at f % frame_history
+  std::array<uint32_t, frame_history> frame_cycles{};
+  uint64_t frames = 0;
+  uint64_t frame_instructions = 0;
+
+private:
+  static bool is_skip(unsigned int family);
+  bool write_json(const char *filename);
+  bool write_csv(const char *filename);
+};
+
+#endif
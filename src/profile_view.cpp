@@ -0,0 +1,172 @@
+#include "profile_view.hpp"
+#include "imgui.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Order rows by the table's current sort column, get_key(row, column)
+// returns the value to compare
+template <typename Key>
+static void sort_rows(std::vector<unsigned int> &rows, Key get_key) {
+  ImGuiTableSortSpecs *specs = ImGui::TableGetSortSpecs();
+  if (specs == nullptr || specs->SpecsCount == 0)
+    return;
+  const ImGuiTableColumnSortSpecs &spec = specs->Specs[0];
+  bool ascending = spec.SortDirection == ImGuiSortDirection_Ascending;
+  std::stable_sort(rows.begin(), rows.end(),
+                   [&](unsigned int a, unsigned int b) {
+                     uint64_t x = get_key(a, spec.ColumnIndex);
+                     uint64_t y = get_key(b, spec.ColumnIndex);
+                     return ascending ? x < y : x > y;
+                   });
+  specs->SpecsDirty = false;
+}
+
+static void draw_families(const Profile &profile) {
+  const ImGuiTableFlags flags = ImGuiTableFlags_Sortable |
+                                ImGuiTableFlags_Borders |
+                                ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
+  if (!ImGui::BeginTable("Families", 3, flags, ImVec2(0, 220)))
+    return;
+  ImGui::TableSetupScrollFreeze(0, 1);
+  ImGui::TableSetupColumn("Family");
+  ImGui::TableSetupColumn("Count",
+                          ImGuiTableColumnFlags_DefaultSort |
+                              ImGuiTableColumnFlags_PreferSortDescending);
+  ImGui::TableSetupColumn("Share", ImGuiTableColumnFlags_NoSort);
+  ImGui::TableHeadersRow();
+
+  // Counts change every frame, so sort every frame
+  std::vector<unsigned int> rows(Profile::family_count);
+  for (unsigned int f = 0; f < Profile::family_count; f++)
+    rows[f] = f;
+  sort_rows(rows, [&](unsigned int f, int column) -> uint64_t {
+    return column == 0 ? f : profile.family_counts[f];
+  });
+
+  for (unsigned int f : rows) {
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    ImGui::TextUnformatted(Profile::family_name(f));
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", (unsigned long long)profile.family_counts[f]);
+    ImGui::TableNextColumn();
+    ImGui::Text("%.2f%%", profile.instructions
+                              ? 100.0 * profile.family_counts[f] /
+                                    profile.instructions
+                              : 0.0);
+  }
+  ImGui::EndTable();
+}
+
+static void draw_hot_addresses(const Profile &profile) {
+  const ImGuiTableFlags flags = ImGuiTableFlags_Sortable |
+                                ImGuiTableFlags_Borders |
+                                ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
+  if (!ImGui::BeginTable("Hot addresses", 2, flags, ImVec2(0, 220)))
+    return;
+  ImGui::TableSetupScrollFreeze(0, 1);
+  ImGui::TableSetupColumn("Address");
+  ImGui::TableSetupColumn("Hits",
+                          ImGuiTableColumnFlags_DefaultSort |
+                              ImGuiTableColumnFlags_PreferSortDescending);
+  ImGui::TableHeadersRow();
+
+  std::vector<unsigned int> rows;
+  for (unsigned int pc = 0; pc < Profile::memory_size; pc++)
+    if (profile.pc_hits[pc] != 0)
+      rows.push_back(pc);
+  sort_rows(rows, [&](unsigned int pc, int column) -> uint64_t {
+    return column == 0 ? pc : profile.pc_hits[pc];
+  });
+
+  ImGuiListClipper clipper;
+  clipper.Begin(rows.size());
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("0x%03X", rows[row]);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)profile.pc_hits[rows[row]]);
+    }
+  }
+  ImGui::EndTable();
+}
+
+static void draw_heat_map(const Profile &profile) {
+  const unsigned int columns = 64;
+  const unsigned int rows = Profile::memory_size / columns;
+  const float cell = 5.0f;
+
+  // Log scale so a hot loop does not wash out everything else
+  uint64_t max_hits = *std::max_element(profile.pc_hits.begin(),
+                                        profile.pc_hits.end());
+  float scale = max_hits ? 1.0f / std::log1p(static_cast<float>(max_hits)) : 0;
+
+  ImDrawList *draw_list = ImGui::GetWindowDrawList();
+  ImVec2 origin = ImGui::GetCursorScreenPos();
+  for (unsigned int address = 0; address < Profile::memory_size; address++) {
+    uint64_t hits = profile.pc_hits[address];
+    float x = origin.x + (address % columns) * cell;
+    float y = origin.y + (address / columns) * cell;
+    ImU32 color = IM_COL32(24, 24, 24, 255);
+    if (hits != 0) {
+      float heat = std::log1p(static_cast<float>(hits)) * scale;
+      color = IM_COL32(static_cast<int>(64 + 191 * heat),
+                       static_cast<int>(192 * heat * heat), 32, 255);
+    }
+    draw_list->AddRectFilled(ImVec2(x, y), ImVec2(x + cell, y + cell), color);
+  }
+  ImGui::Dummy(ImVec2(columns * cell, rows * cell));
+
+  if (ImGui::IsItemHovered()) {
+    ImVec2 mouse = ImGui::GetMousePos();
+    unsigned int column = (mouse.x - origin.x) / cell;
+    unsigned int row = (mouse.y - origin.y) / cell;
+    if (column < columns && row < rows) {
+      unsigned int address = row * columns + column;
+      ImGui::SetTooltip("0x%03X: %llu", address,
+                        (unsigned long long)profile.pc_hits[address]);
+    }
+  }
+}
+
+bool draw_profile(const Profile &profile) {
+  ImGui::Text("Instructions: %llu", (unsigned long long)profile.instructions);
+  uint64_t skips = profile.skips_taken + profile.skips_not_taken;
+  ImGui::Text("Skips: %llu taken, %llu not taken (%.1f%% taken)",
+              (unsigned long long)profile.skips_taken,
+              (unsigned long long)profile.skips_not_taken,
+              skips ? 100.0 * profile.skips_taken / skips : 0.0);
+  ImGui::Text("Sprites: %llu draws, %llu rows, %llu collisions",
+              (unsigned long long)profile.sprites,
+              (unsigned long long)profile.sprite_rows,
+              (unsigned long long)profile.collisions);
+  bool reset = ImGui::Button("Reset");
+
+  // Oldest recorded frame on the left
+  float cycles[Profile::frame_history];
+  uint64_t count = std::min<uint64_t>(profile.frames, Profile::frame_history);
+  uint64_t first = profile.frames - count;
+  for (uint64_t f = first; f < profile.frames; f++)
+    cycles[f - first] = profile.frame_cycles[f % Profile::frame_history];
+  ImGui::PlotLines("Cycles/frame", cycles, count, 0, nullptr, 0.0f, FLT_MAX,
+                   ImVec2(0, 60));
+
+  if (ImGui::TreeNode("Opcode families")) {
+    draw_families(profile);
+    ImGui::TreePop();
+  }
+  if (ImGui::TreeNode("Hot addresses")) {
+    draw_hot_addresses(profile);
+    ImGui::TreePop();
+  }
+  if (ImGui::TreeNode("PC heat map")) {
+    draw_heat_map(profile);
+    ImGui::TreePop();
+  }
+  return reset;
+}
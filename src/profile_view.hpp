@@ -0,0 +1,12 @@
+#ifndef PROFILE_VIEW_H
+#define PROFILE_VIEW_H
+
+#include "profile.hpp"
+
+// Draw the profiler's counters into the current ImGui window: sortable
+// opcode family and hot address tables, cycles per frame and a 64x64 heat
+// map of PC hits (one cell per byte of memory). Returns true when the reset
+// button was pressed.
+bool draw_profile(const Profile &profile);
+
+#endif
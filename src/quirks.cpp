@@ -0,0 +1,26 @@
+#include "quirks.hpp"
+#include <cstring>
+
+static const char *const profile_names[] = {"default", "vip", "chip48",
+                                            "schip"};
+
+const char *quirk_profile_name(QuirkProfile profile) {
+  return profile_names[profile];
+}
+
+bool parse_quirk_profile(const char *name, QuirkProfile &profile) {
+  for (int p = QUIRKS_DEFAULT; p <= QUIRKS_SCHIP; p++) {
+    if (std::strcmp(name, profile_names[p]) == 0) {
+      profile = static_cast<QuirkProfile>(p);
+      return true;
+    }
+  }
+  return false;
+}
+
+QuirkProfile quirk_profile_for_rom(const char *filename) {
+  size_t length = std::strlen(filename);
+  if (length >= 4 && std::strcmp(filename + length - 4, ".sc8") == 0)
+    return QUIRKS_SCHIP;
+  return QUIRKS_DEFAULT;
+}
@@ -0,0 +1,54 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+// Instruction behaviours that differ between CHIP-8 implementations. The
+// interpreter and cached engines are instantiated once per profile so the
+// choice costs nothing per instruction, the JIT reads it while translating.
+enum QuirkProfile {
+  // This emulator's original behaviour
+  QUIRKS_DEFAULT,
+  // The COSMAC VIP interpreter
+  QUIRKS_VIP,
+  // CHIP-48 on the HP-48
+  QUIRKS_CHIP48,
+  // SUPER-CHIP 1.1
+  QUIRKS_SCHIP
+};
+
+// Where FX55 and FX65 leave I
+enum MemoryIndex { KEEP_I, ADVANCE_I_BY_X, ADVANCE_I_PAST_X };
+
+struct Quirks {
+  // 8XY6 and 8XYE shift VY into VX instead of shifting VX in place
+  bool shift_vy;
+  MemoryIndex memory_index;
+  // DXYN clips sprites at the right and bottom edges instead of wrapping
+  bool clip_sprites;
+  // BNNN reads as BXNN and jumps to XNN + VX instead of NNN + V0
+  bool jump_vx;
+  // 8XY1, 8XY2 and 8XY3 clear VF
+  bool reset_vf;
+};
+
+constexpr Quirks quirks_for(QuirkProfile profile) {
+  switch (profile) {
+  case QUIRKS_VIP:
+    return {true, ADVANCE_I_PAST_X, true, false, true};
+  case QUIRKS_CHIP48:
+    return {false, ADVANCE_I_BY_X, true, true, false};
+  case QUIRKS_SCHIP:
+    return {false, KEEP_I, true, true, false};
+  default:
+    return {false, KEEP_I, false, false, false};
+  }
+}
+
+// Names used on the command line: default, vip, chip48 and schip
+const char *quirk_profile_name(QuirkProfile profile);
+// Returns false for an unknown name
+bool parse_quirk_profile(const char *name, QuirkProfile &profile);
+// Profile implied by a rom's file name: .sc8 roms are SUPER-CHIP programs,
+// everything else gets the default
+QuirkProfile quirk_profile_for_rom(const char *filename);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Random generator behind CXNN, shared by every engine so they produce the
+// same sequence from the same seed
+
+// splitmix64 spreads nearby seeds apart and never yields the all-zero state
+// xorshift cannot leave
+inline uint64_t random_state_from_seed(uint64_t seed) {
+  uint64_t z = seed + 0x9E3779B97F4A7C15;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  z ^= z >> 31;
+  return z != 0 ? z : 0x9E3779B97F4A7C15;
+}
+
+// xorshift64*, returns the top byte of the scrambled state
+inline uint8_t random_next_byte(uint64_t &state) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return (state * 0x2545F4914F6CDD1D) >> 56;
+}
+
+#endif
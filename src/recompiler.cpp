@@ -0,0 +1,541 @@
+#include "recompiler.hpp"
+#include "chip8.hpp"
+#include <algorithm>
+#include <iostream>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define RECOMPILER_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define RECOMPILER_SUPPORTED 0
+#endif
+
+namespace {
+// Room kept free in the code buffer for one block (64 instructions of the
+// largest translation plus epilogues)
+const size_t max_block_bytes = 32 * 1024;
+
+// How a block treats an instruction
+enum Kind {
+  // Translated inline
+  STRAIGHT,
+  // Translated and ends the block (jumps, calls, returns, skips)
+  BRANCH,
+  // Ends the block before it, executed by the interpreter
+  FALLBACK
+};
+
+Kind classify(uint16_t opcode) {
+  uint8_t NN = opcode & 0x00FF;
+  switch ((opcode & 0xF000) >> 12) {
+  case 0x0:
+    if (NN == 0xE0)
+      return Kind::FALLBACK;
+    if (NN == 0xEE)
+      return Kind::BRANCH;
+    return Kind::STRAIGHT;
+  case 0x1:
+  case 0x2:
+  case 0x3:
+  case 0x4:
+  case 0x5:
+  case 0x9:
+  case 0xB:
+    return Kind::BRANCH;
+  case 0xC:
+  case 0xD:
+    return Kind::FALLBACK;
+  case 0xE:
+    return (NN == 0x9E || NN == 0xA1) ? Kind::FALLBACK : Kind::STRAIGHT;
+  case 0xF:
+    switch (NN) {
+    case 0x0A:
+    // Interpreted so run() can end right after a sound edge
+    case 0x18:
+    case 0x33:
+    case 0x55:
+      return Kind::FALLBACK;
+    default:
+      return Kind::STRAIGHT;
+    }
+  default:
+    return Kind::STRAIGHT;
+  }
+}
+
+// Appends x86-64 machine code to a buffer
+class Emitter {
+public:
+  explicit Emitter(uint8_t *cursor) : cursor(cursor) {}
+
+  uint8_t *here() { return this->cursor; }
+
+  void byte(uint8_t b) { *this->cursor++ = b; }
+  void bytes(std::initializer_list<uint8_t> bs) {
+    for (uint8_t b : bs)
+      this->byte(b);
+  }
+  void u16(uint16_t v) {
+    this->byte(v & 0xFF);
+    this->byte(v >> 8);
+  }
+  void u32(uint32_t v) {
+    for (int i = 0; i < 4; i++)
+      this->byte((v >> (8 * i)) & 0xFF);
+  }
+  void u64(uint64_t v) {
+    for (int i = 0; i < 8; i++)
+      this->byte((v >> (8 * i)) & 0xFF);
+  }
+  // 32-bit displacement from the end of the field to target
+  void rel32(const uint8_t *target) {
+    this->u32(static_cast<uint32_t>(target - (this->cursor + 4)));
+  }
+  // Point a previously emitted rel32 field at the current position
+  void patch_rel32(uint8_t *field) {
+    uint32_t rel = static_cast<uint32_t>(this->cursor - (field + 4));
+    for (int i = 0; i < 4; i++)
+      field[i] = (rel >> (8 * i)) & 0xFF;
+  }
+
+  // Instruction with a [rbx + disp32] operand, reg is the ModRM reg field
+  void rbx_mem(std::initializer_list<uint8_t> op, uint8_t reg, int32_t disp) {
+    this->bytes(op);
+    this->byte(0x80 | (reg << 3) | 0x3);
+    this->u32(static_cast<uint32_t>(disp));
+  }
+  // Instruction with a [rbx + rax * scale + disp32] operand
+  void rbx_rax_mem(std::initializer_list<uint8_t> op, uint8_t reg,
+                   uint8_t scale_bits, int32_t disp) {
+    this->bytes(op);
+    this->byte(0x80 | (reg << 3) | 0x4);
+    this->byte((scale_bits << 6) | (0x0 << 3) | 0x3);
+    this->u32(static_cast<uint32_t>(disp));
+  }
+
+private:
+  uint8_t *cursor;
+};
+
+// Register numbers used in ModRM reg fields
+const uint8_t AL = 0;
+const uint8_t CL = 1;
+
+// Byte offsets of the CHIP8 state used by generated code, relative to the
+// CHIP8 pointer kept in rbx
+struct Offsets {
+  int32_t V, I, PC, SP, DT, opcode, stack, memory;
+
+  explicit Offsets(const CHIP8 &c8) {
+    auto offset = [&c8](const void *field) {
+      return static_cast<int32_t>(static_cast<const uint8_t *>(field) -
+                                  reinterpret_cast<const uint8_t *>(&c8));
+    };
+    this->V = offset(c8.V.data());
+    this->I = offset(&c8.I);
+    this->PC = offset(&c8.PC);
+    this->SP = offset(&c8.SP);
+    this->DT = offset(&c8.DT);
+    this->opcode = offset(&c8.opcode);
+    this->stack = offset(c8.stack.data());
+    this->memory = offset(c8.memory.data());
+  }
+};
+} // namespace
+
+Recompiler::Recompiler() {
+#if RECOMPILER_SUPPORTED
+  void *buffer = mmap(nullptr, Recompiler::code_buffer_size,
+                      PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED) {
+    std::cerr << "[ERROR] Recompiler: failed to allocate executable memory"
+              << std::endl;
+    return;
+  }
+  this->code = static_cast<uint8_t *>(buffer);
+
+  Emitter e(this->code);
+  // enter(c8, budget, block): keep the CHIP8 pointer in rbx and the
+  // remaining instruction budget in r13 while blocks run
+  this->enter = reinterpret_cast<uint64_t (*)(CHIP8 *, uint64_t, uint8_t *)>(
+      e.here());
+  e.bytes({0x53});             // push rbx
+  e.bytes({0x41, 0x55});       // push r13
+  e.bytes({0x48, 0x89, 0xFB}); // mov rbx, rdi
+  e.bytes({0x49, 0x89, 0xF5}); // mov r13, rsi
+  e.bytes({0xFF, 0xE2});       // jmp rdx
+  // Return the remaining budget
+  this->exit_stub = e.here();
+  e.bytes({0x4C, 0x89, 0xE8}); // mov rax, r13
+  e.bytes({0x41, 0x5D});       // pop r13
+  e.bytes({0x5B});             // pop rbx
+  e.bytes({0xC3});             // ret
+
+  this->stubs_size = e.here() - this->code;
+  this->code_used = this->stubs_size;
+#endif
+}
+
+Recompiler::~Recompiler() {
+#if RECOMPILER_SUPPORTED
+  if (this->code != nullptr)
+    munmap(this->code, Recompiler::code_buffer_size);
+#endif
+}
+
+bool Recompiler::is_available() { return this->code != nullptr; }
+
+uint64_t Recompiler::run(CHIP8 &c8, uint64_t cycles) {
+  uint64_t remaining = cycles;
+  while (remaining > 0) {
+    uint16_t pc = c8.PC;
+    if (pc < 0xFFF && this->states[pc] == BlockState::UNKNOWN)
+      this->translate(c8, pc);
+
+    if (pc < 0xFFF && this->states[pc] == BlockState::TRANSLATED &&
+        this->blocks[pc].length <= remaining) {
+      // Runs chained blocks until one does not fit in the budget or the next
+      // address has no translation
+      remaining = this->enter(&c8, remaining, this->entries[pc]);
+    } else {
+      c8.execute_cached();
+      remaining--;
+      if (c8.sound_edge)
+        return cycles - remaining;
+    }
+  }
+
+  return cycles;
+}
+
+void Recompiler::invalidate(uint16_t address) {
+  address &= Recompiler::memory_size - 1;
+  uint16_t previous = (address - 1) & (Recompiler::memory_size - 1);
+  // Instructions starting here may have become translatable
+  if (this->states[address] == BlockState::UNTRANSLATABLE)
+    this->states[address] = BlockState::UNKNOWN;
+  if (this->states[previous] == BlockState::UNTRANSLATABLE)
+    this->states[previous] = BlockState::UNKNOWN;
+
+  std::vector<uint16_t> &page = this->pages[address >> Recompiler::page_shift];
+  for (size_t i = 0; i < page.size();) {
+    uint16_t start = page[i];
+    // remove_block() erases the entry at i
+    if (start <= address && address < this->blocks[start].end)
+      this->remove_block(start);
+    else
+      i++;
+  }
+}
+
+void Recompiler::flush() {
+  this->entries.fill(nullptr);
+  this->states.fill(BlockState::UNKNOWN);
+  for (std::vector<uint16_t> &page : this->pages)
+    page.clear();
+  // Keep the entry and exit stubs at the start of the buffer
+  this->code_used = this->stubs_size;
+}
+
+void Recompiler::prewarm(CHIP8 &c8, uint16_t address) {
+  if (address < 0xFFF && this->states[address] == BlockState::UNKNOWN)
+    this->translate(c8, address);
+}
+
+void Recompiler::remove_block(uint16_t address) {
+  this->entries[address] = nullptr;
+  this->states[address] = BlockState::UNKNOWN;
+  unsigned int first = address >> Recompiler::page_shift;
+  unsigned int last = (this->blocks[address].end - 1) >> Recompiler::page_shift;
+  for (unsigned int p = first; p <= last && p < Recompiler::page_count; p++) {
+    std::vector<uint16_t> &page = this->pages[p];
+    page.erase(std::remove(page.begin(), page.end(), address), page.end());
+  }
+}
+
+bool Recompiler::translate(CHIP8 &c8, uint16_t address) {
+  if (this->code == nullptr) {
+    this->states[address] = BlockState::UNTRANSLATABLE;
+    return false;
+  }
+
+  // Collect the straight-line run of instructions
+  std::array<uint16_t, Recompiler::max_block_length> opcodes;
+  uint16_t length = 0;
+  uint16_t pc = address;
+  bool branch = false;
+  while (length < Recompiler::max_block_length && pc < 0xFFF) {
+    uint16_t opcode = (c8.memory[pc] << 8) | c8.memory[pc + 1];
+    Kind kind = classify(opcode);
+    if (kind == Kind::FALLBACK)
+      break;
+    opcodes[length++] = opcode;
+    pc += 2;
+    if (kind == Kind::BRANCH) {
+      branch = true;
+      break;
+    }
+  }
+
+  if (length == 0) {
+    this->states[address] = BlockState::UNTRANSLATABLE;
+    return false;
+  }
+
+  if (this->code_used + max_block_bytes > Recompiler::code_buffer_size)
+    this->flush();
+
+  const Offsets off(c8);
+  // Quirks are fixed per translation, set_quirks flushes every block
+  const Quirks quirks = quirks_for(c8.get_quirks());
+  const uint16_t last_opcode = opcodes[length - 1];
+  uint8_t *block = this->code + this->code_used;
+  Emitter e(block);
+
+  // Leave PC and opcode behind and continue with the block at target, or
+  // return to run() if there is none
+  auto static_exit = [&](uint16_t target) {
+    e.rbx_mem({0x66, 0xC7}, 0, off.PC); // mov word [PC], target
+    e.u16(target);
+    e.rbx_mem({0x66, 0xC7}, 0, off.opcode); // mov word [opcode], last
+    e.u16(last_opcode);
+    if (target < 0xFFF) {
+      e.bytes({0x48, 0xB8}); // mov rax, &entries[target]
+      e.u64(reinterpret_cast<uint64_t>(&this->entries[target]));
+      e.bytes({0x48, 0x8B, 0x00}); // mov rax, [rax]
+      e.bytes({0x48, 0x85, 0xC0}); // test rax, rax
+      e.bytes({0x0F, 0x84});       // jz exit_stub
+      e.rel32(this->exit_stub);
+      e.bytes({0xFF, 0xE0}); // jmp rax
+    } else {
+      e.byte(0xE9); // jmp exit_stub
+      e.rel32(this->exit_stub);
+    }
+  };
+  // Same with the target computed into eax
+  auto dynamic_exit = [&]() {
+    e.rbx_mem({0x66, 0x89}, AL, off.PC); // mov [PC], ax
+    e.rbx_mem({0x66, 0xC7}, 0, off.opcode);
+    e.u16(last_opcode);
+    e.byte(0x3D); // cmp eax, 0xFFE
+    e.u32(0xFFE);
+    e.bytes({0x0F, 0x87}); // ja exit_stub
+    e.rel32(this->exit_stub);
+    e.bytes({0x48, 0xB9}); // mov rcx, entries
+    e.u64(reinterpret_cast<uint64_t>(this->entries.data()));
+    e.bytes({0x48, 0x8B, 0x04, 0xC1}); // mov rax, [rcx + rax * 8]
+    e.bytes({0x48, 0x85, 0xC0});       // test rax, rax
+    e.bytes({0x0F, 0x84});             // jz exit_stub
+    e.rel32(this->exit_stub);
+    e.bytes({0xFF, 0xE0}); // jmp rax
+  };
+  // Skip instructions: condition flags are set, jcc is the taken condition
+  auto skip_exit = [&](uint8_t jcc, uint16_t next) {
+    e.bytes({0x0F, jcc});
+    uint8_t *taken = e.here();
+    e.u32(0);
+    static_exit(next);
+    e.patch_rel32(taken);
+    static_exit(next + 2);
+  };
+
+  // Bail out to run() when the budget cannot cover the whole block
+  e.bytes({0x49, 0x81, 0xFD}); // cmp r13, length
+  e.u32(length);
+  e.bytes({0x0F, 0x82}); // jb exit_stub
+  e.rel32(this->exit_stub);
+  e.bytes({0x49, 0x81, 0xED}); // sub r13, length
+  e.u32(length);
+
+  for (uint16_t i = 0; i < length; i++) {
+    uint16_t opcode = opcodes[i];
+    // Address of the following instruction
+    uint16_t next = address + 2 * (i + 1);
+    uint8_t X = (opcode & 0x0F00) >> 8;
+    uint8_t Y = (opcode & 0x00F0) >> 4;
+    uint8_t N = opcode & 0x000F;
+    uint8_t NN = opcode & 0x00FF;
+    uint16_t NNN = opcode & 0x0FFF;
+    int32_t VX = off.V + X;
+    int32_t VY = off.V + Y;
+    int32_t VF = off.V + 0xF;
+
+    switch ((opcode & 0xF000) >> 12) {
+    case 0x0:
+      if (NN == 0xEE) { // 00EE - RET
+        e.rbx_mem({0x0F, 0xB6}, AL, off.SP); // movzx eax, byte [SP]
+        // movzx eax, word [stack + rax * 2]
+        e.rbx_rax_mem({0x0F, 0xB7}, AL, 1, off.stack);
+        e.rbx_mem({0xFE}, 1, off.SP); // dec byte [SP]
+        dynamic_exit();
+      }
+      break;
+    case 0x1: // 1NNN - JP addr
+      static_exit(NNN);
+      break;
+    case 0x2:                           // 2NNN - CALL addr
+      e.rbx_mem({0xFE}, 0, off.SP);     // inc byte [SP]
+      e.rbx_mem({0x0F, 0xB6}, AL, off.SP); // movzx eax, byte [SP]
+      // mov word [stack + rax * 2], next
+      e.rbx_rax_mem({0x66, 0xC7}, 0, 1, off.stack);
+      e.u16(next);
+      static_exit(NNN);
+      break;
+    case 0x3:                       // 3XNN - SE VX, byte
+      e.rbx_mem({0x80}, 7, VX);     // cmp byte [VX], NN
+      e.byte(NN);
+      skip_exit(0x84, next);        // je
+      break;
+    case 0x4:                       // 4XNN - SNE VX, byte
+      e.rbx_mem({0x80}, 7, VX);
+      e.byte(NN);
+      skip_exit(0x85, next);        // jne
+      break;
+    case 0x5:                       // 5XY0 - SE VX, VY
+      e.rbx_mem({0x8A}, AL, VX);    // mov al, [VX]
+      e.rbx_mem({0x3A}, AL, VY);    // cmp al, [VY]
+      skip_exit(0x84, next);
+      break;
+    case 0x6:                       // 6XNN - LD VX, byte
+      e.rbx_mem({0xC6}, 0, VX);
+      e.byte(NN);
+      break;
+    case 0x7:                       // 7XNN - ADD VX, byte
+      e.rbx_mem({0x80}, 0, VX);
+      e.byte(NN);
+      break;
+    case 0x8:
+      switch (N) {
+      case 0x0: // 8XY0 - LD VX, VY
+        e.rbx_mem({0x8A}, AL, VY);
+        e.rbx_mem({0x88}, AL, VX);
+        break;
+      case 0x1: // 8XY1 - OR VX, VY
+      case 0x2: // 8XY2 - AND VX, VY
+      case 0x3: // 8XY3 - XOR VX, VY
+        e.rbx_mem({0x8A}, AL, VX);
+        e.rbx_mem({N == 0x1 ? uint8_t(0x0A) : N == 0x2 ? uint8_t(0x22)
+                                                       : uint8_t(0x32)},
+                  AL, VY);
+        e.rbx_mem({0x88}, AL, VX);
+        if (quirks.reset_vf) {
+          e.rbx_mem({0xC6}, 0, VF); // mov byte [VF], 0
+          e.byte(0);
+        }
+        break;
+      case 0x4: // 8XY4 - ADD VX, VY
+        e.rbx_mem({0x8A}, AL, VX);
+        e.rbx_mem({0x02}, AL, VY);         // add al, [VY]
+        e.bytes({0x0F, 0x92, 0xC1});       // setc cl
+        e.rbx_mem({0x88}, AL, VX);
+        e.rbx_mem({0x88}, CL, VF);
+        break;
+      case 0x5: // 8XY5 - SUB VX, VY
+        e.rbx_mem({0x8A}, AL, VX);
+        e.rbx_mem({0x2A}, AL, VY);         // sub al, [VY]
+        e.bytes({0x0F, 0x93, 0xC1});       // setnc cl
+        e.rbx_mem({0x88}, AL, VX);
+        e.rbx_mem({0x88}, CL, VF);
+        break;
+      case 0x6: // 8XY6 - SHR VX {, VY}
+        e.rbx_mem({0x8A}, AL, quirks.shift_vy ? VY : VX);
+        e.bytes({0x88, 0xC1});             // mov cl, al
+        e.bytes({0x80, 0xE1, 0x01});       // and cl, 1
+        e.bytes({0xD0, 0xE8});             // shr al, 1
+        e.rbx_mem({0x88}, AL, VX);
+        e.rbx_mem({0x88}, CL, VF);
+        break;
+      case 0x7: // 8XY7 - SUBN VX, VY
+        e.rbx_mem({0x8A}, AL, VY);
+        e.rbx_mem({0x2A}, AL, VX);         // sub al, [VX]
+        e.bytes({0x0F, 0x93, 0xC1});       // setnc cl
+        e.rbx_mem({0x88}, AL, VX);
+        e.rbx_mem({0x88}, CL, VF);
+        break;
+      case 0xE: // 8XYE - SHL VX {, VY}
+        e.rbx_mem({0x8A}, AL, quirks.shift_vy ? VY : VX);
+        e.bytes({0x88, 0xC1});             // mov cl, al
+        e.bytes({0xC0, 0xE9, 0x07});       // shr cl, 7
+        e.bytes({0xD0, 0xE0});             // shl al, 1
+        e.rbx_mem({0x88}, AL, VX);
+        e.rbx_mem({0x88}, CL, VF);
+        break;
+      default:
+        break;
+      }
+      break;
+    case 0x9:                       // 9XY0 - SNE VX, VY
+      e.rbx_mem({0x8A}, AL, VX);
+      e.rbx_mem({0x3A}, AL, VY);
+      skip_exit(0x85, next);
+      break;
+    case 0xA:                       // ANNN - LD I, addr
+      e.rbx_mem({0x66, 0xC7}, 0, off.I);
+      e.u16(NNN);
+      break;
+    case 0xB:                       // BNNN - JP V0, addr
+      // movzx eax, byte [V0], or [VX] with the jump_vx quirk
+      e.rbx_mem({0x0F, 0xB6}, AL, quirks.jump_vx ? VX : off.V);
+      e.byte(0x05);                       // add eax, NNN
+      e.u32(NNN);
+      dynamic_exit();
+      break;
+    case 0xF:
+      switch (NN) {
+      case 0x07: // FX07 - LD VX, DT
+        e.rbx_mem({0x8A}, AL, off.DT);
+        e.rbx_mem({0x88}, AL, VX);
+        break;
+      case 0x15: // FX15 - LD DT, VX
+        e.rbx_mem({0x8A}, AL, VX);
+        e.rbx_mem({0x88}, AL, off.DT);
+        break;
+      case 0x1E: // FX1E - ADD I, VX
+        e.rbx_mem({0x0F, 0xB6}, AL, VX);  // movzx eax, byte [VX]
+        e.rbx_mem({0x66, 0x01}, AL, off.I); // add [I], ax
+        break;
+      case 0x29: // FX29 - LD F, VX
+        e.rbx_mem({0x0F, 0xB6}, AL, VX);
+        e.bytes({0x8D, 0x04, 0x80}); // lea eax, [rax + rax * 4]
+        // movzx eax, byte [memory + fontset + rax]
+        e.rbx_rax_mem({0x0F, 0xB6}, AL, 0,
+                      off.memory + CHIP8::fontset_start_address);
+        e.rbx_mem({0x66, 0x89}, AL, off.I); // mov [I], ax
+        break;
+      case 0x65: // FX65 - LD VX, [I]
+        e.rbx_mem({0x0F, 0xB7}, AL, off.I); // movzx eax, word [I]
+        for (int x = 0; x <= X; x++) {
+          // mov cl, [memory + rax + x]
+          e.rbx_rax_mem({0x8A}, CL, 0, off.memory + x);
+          e.rbx_mem({0x88}, CL, off.V + x);
+        }
+        if (quirks.memory_index != KEEP_I) {
+          e.rbx_mem({0x66, 0x83}, 0, off.I); // add word [I], X or X + 1
+          e.byte(quirks.memory_index == ADVANCE_I_BY_X ? X : X + 1);
+        }
+        break;
+      default:
+        break;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Straight-line blocks fall through to the instruction after them
+  if (!branch)
+    static_exit(pc);
+
+  this->code_used += e.here() - block;
+  this->entries[address] = block;
+  this->states[address] = BlockState::TRANSLATED;
+  this->blocks[address] = {pc, length};
+  unsigned int first = address >> Recompiler::page_shift;
+  unsigned int last = (pc - 1) >> Recompiler::page_shift;
+  for (unsigned int p = first; p <= last && p < Recompiler::page_count; p++)
+    this->pages[p].push_back(address);
+
+  return true;
+}
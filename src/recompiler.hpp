@@ -0,0 +1,75 @@
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CHIP8;
+
+// Basic-block recompiler that translates straight-line runs of CHIP-8
+// instructions into x86-64 code operating directly on a CHIP8's registers and
+// memory. Blocks end at jumps, calls, returns and skips, and blocks chain into
+// each other through a per-address entry table without returning to C++.
+// Instructions that touch peripherals, the random generator or store to
+// memory (00E0, CXNN, DXYN, EX9E, EXA1, FX0A, FX33, FX55) are executed by the
+// cached interpreter instead.
+class Recompiler {
+public:
+  Recompiler();
+  ~Recompiler();
+  Recompiler(const Recompiler &) = delete;
+  Recompiler &operator=(const Recompiler &) = delete;
+
+  // False on hosts without x86-64 support or executable memory
+  bool is_available();
+  // Execute the given number of instructions, returns how many ran (fewer
+  // only after a sound edge, see CHIP8::run())
+  uint64_t run(CHIP8 &c8, uint64_t cycles);
+  // Drop translated blocks covering this address (called on every store)
+  void invalidate(uint16_t address);
+  // Drop every translated block
+  void flush();
+  // Translate the block at address now instead of on first execution
+  void prewarm(CHIP8 &c8, uint16_t address);
+
+private:
+  static const unsigned int memory_size = 4096;
+  static const unsigned int page_shift = 6;
+  static const unsigned int page_count = memory_size >> page_shift;
+  // Longest run of instructions translated into a single block
+  static const unsigned int max_block_length = 64;
+  static const size_t code_buffer_size = 1 << 20;
+
+  struct Block {
+    uint16_t end;    // one past the last byte of the block
+    uint16_t length; // instructions in the block
+  };
+
+  enum BlockState : uint8_t { UNKNOWN, TRANSLATED, UNTRANSLATABLE };
+
+  // Translate the block starting at address, returns false if the first
+  // instruction there has to be interpreted
+  bool translate(CHIP8 &c8, uint16_t address);
+  void remove_block(uint16_t address);
+
+  // Generated code, entry points of translated blocks indexed by address
+  // (null when there is no block) for chaining from generated code
+  uint8_t *code = nullptr;
+  size_t code_used = 0;
+  // Bytes taken by the entry and exit stubs, blocks are emitted after them
+  size_t stubs_size = 0;
+  // Returns to run() with the remaining budget
+  uint8_t *exit_stub = nullptr;
+  // Saves registers and jumps to a block: (c8, budget, block) -> budget left
+  uint64_t (*enter)(CHIP8 *, uint64_t, uint8_t *) = nullptr;
+  std::array<uint8_t *, memory_size> entries{};
+
+  std::array<Block, memory_size> blocks{};
+  std::array<BlockState, memory_size> states{};
+  // Start addresses of the blocks overlapping each page of memory
+  std::array<std::vector<uint16_t>, page_count> pages;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "rom_file.hpp"
+#include "chip8.hpp"
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ROM_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define ROM_FILE_MMAP 0
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#endif
+
+RomFile::~RomFile() { this->close(); }
+
+// Size a rom must have to fit the program area, logs the reason otherwise
+static bool check_size(const char *filename, uint64_t size) {
+  if (size == 0) {
+    std::cerr << "[ERROR] Rom " << filename << " is empty" << std::endl;
+    return false;
+  }
+  if (size > CHIP8::max_rom_size) {
+    std::cerr << "[ERROR] Rom " << filename << " is " << size
+              << " bytes, the program area only holds " << CHIP8::max_rom_size
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool RomFile::open(const char *filename) {
+  this->close();
+  if (filename == nullptr || *filename == '\0') {
+    std::cerr << "[ERROR] No rom given" << std::endl;
+    return false;
+  }
+
+#if ROM_FILE_MMAP
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "[ERROR] Failed to open rom " << filename << std::endl;
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+    std::cerr << "[ERROR] " << filename << " is not a file" << std::endl;
+    ::close(fd);
+    return false;
+  }
+  if (!check_size(filename, status.st_size)) {
+    ::close(fd);
+    return false;
+  }
+  void *address =
+      mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid without the descriptor
+  ::close(fd);
+  if (address == MAP_FAILED) {
+    std::cerr << "[ERROR] Failed to map rom " << filename << std::endl;
+    return false;
+  }
+  this->bytes = static_cast<const uint8_t *>(address);
+  this->length = status.st_size;
+  this->mapped = true;
+#else
+  std::error_code error;
+  if (!std::filesystem::is_regular_file(filename, error)) {
+    std::cerr << "[ERROR] " << filename << " is not a file" << std::endl;
+    return false;
+  }
+  if (!check_size(filename, std::filesystem::file_size(filename, error)))
+    return false;
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open rom " << filename << std::endl;
+    return false;
+  }
+  this->buffer.assign(std::istreambuf_iterator<char>(file),
+                      std::istreambuf_iterator<char>());
+  if (!check_size(filename, this->buffer.size()))
+    return false;
+  this->bytes = this->buffer.data();
+  this->length = this->buffer.size();
+#endif
+  return true;
+}
+
+void RomFile::close() {
+#if ROM_FILE_MMAP
+  if (this->mapped)
+    munmap(const_cast<uint8_t *>(this->bytes), this->length);
+#endif
+  this->bytes = nullptr;
+  this->length = 0;
+  this->mapped = false;
+  this->buffer.clear();
+}
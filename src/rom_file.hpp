@@ -0,0 +1,35 @@
+#ifndef ROM_FILE_H
+#define ROM_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A rom file mapped read-only into memory, so loading it copies the bytes
+// straight from the page cache into CHIP8 memory without a temporary
+// buffer. Hosts without mmap read the file into a buffer instead.
+// Files that are not regular files, empty or larger than the program area
+// are refused before anything is read.
+class RomFile {
+public:
+  RomFile() = default;
+  ~RomFile();
+  RomFile(const RomFile &) = delete;
+  RomFile &operator=(const RomFile &) = delete;
+
+  // Returns false (and logs why) if the file can not be used as a rom
+  bool open(const char *filename);
+  void close();
+
+  bool is_open() const { return this->bytes != nullptr; }
+  const uint8_t *data() const { return this->bytes; }
+  size_t size() const { return this->length; }
+
+private:
+  const uint8_t *bytes = nullptr;
+  size_t length = 0;
+  bool mapped = false;
+  std::vector<uint8_t> buffer;
+};
+
+#endif
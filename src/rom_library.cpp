@@ -0,0 +1,300 @@
+#include "rom_library.hpp"
+#include "analyzer.hpp"
+#include "byte_io.hpp"
+#include "rom_file.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+const char *const RomLibrary::default_index_name = "chip8_library.idx";
+
+// FNV-1a, the same hash Display::hash uses
+static uint64_t content_hash(const uint8_t *data, size_t size) {
+  uint64_t hash = 0xCBF29CE484222325;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001B3;
+  }
+  return hash;
+}
+
+static bool by_path(const RomEntry &a, const RomEntry &b) {
+  return a.path < b.path;
+}
+
+static bool is_rom(const fs::path &path) {
+  std::string extension = path.extension().string();
+  return extension == ".ch8" || extension == ".c8" || extension == ".sc8";
+}
+
+bool RomLibrary::load(const char *filename) {
+  std::error_code error;
+  if (!fs::exists(filename, error)) {
+    this->entries.clear();
+    return true;
+  }
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+  std::vector<uint8_t> in((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+
+  size_t position = 0;
+  uint64_t magic, version, count;
+  if (!get_uint(in, position, 4, magic) || magic != RomLibrary::magic_value) {
+    std::cerr << "[ERROR] " << filename << " is not a rom library index"
+              << std::endl;
+    return false;
+  }
+  if (!get_uint(in, position, 4, version)) {
+    std::cerr << "[ERROR] " << filename << " is truncated" << std::endl;
+    return false;
+  }
+  if (version != RomLibrary::version_value) {
+    std::cerr << "[ERROR] Rom library index version " << version
+              << " is not supported" << std::endl;
+    return false;
+  }
+  if (!get_uint(in, position, 4, count)) {
+    std::cerr << "[ERROR] " << filename << " is truncated" << std::endl;
+    return false;
+  }
+
+  std::vector<RomEntry> entries;
+  for (uint64_t i = 0; i < count; i++) {
+    RomEntry entry;
+    uint64_t length, size, mtime, hash, quirks, runs, cycles, display_hash,
+        microseconds;
+    if (!get_uint(in, position, 2, length) ||
+        position + length > in.size()) {
+      std::cerr << "[ERROR] " << filename << " is truncated" << std::endl;
+      return false;
+    }
+    entry.path.assign(in.begin() + position, in.begin() + position + length);
+    position += length;
+    if (!get_uint(in, position, 4, size) || !get_uint(in, position, 8, mtime) ||
+        !get_uint(in, position, 8, hash) ||
+        !get_uint(in, position, 1, quirks) ||
+        !get_uint(in, position, 4, runs) ||
+        !get_uint(in, position, 8, cycles) ||
+        !get_uint(in, position, 8, display_hash) ||
+        !get_uint(in, position, 8, microseconds) || quirks > QUIRKS_SCHIP) {
+      std::cerr << "[ERROR] " << filename << " is truncated" << std::endl;
+      return false;
+    }
+    entry.size = size;
+    entry.mtime = static_cast<int64_t>(mtime);
+    entry.hash = hash;
+    entry.quirks = static_cast<QuirkProfile>(quirks);
+    entry.runs = runs;
+    entry.last_cycles = cycles;
+    entry.last_display_hash = display_hash;
+    entry.last_seconds = microseconds / 1e6;
+    entries.push_back(std::move(entry));
+  }
+
+  // Written sorted, but find() must not depend on the file being well formed
+  std::sort(entries.begin(), entries.end(), by_path);
+  this->entries = std::move(entries);
+  return true;
+}
+
+bool RomLibrary::save(const char *filename) {
+  std::vector<uint8_t> out;
+  put_uint(out, RomLibrary::magic_value, 4);
+  put_uint(out, RomLibrary::version_value, 4);
+  put_uint(out, this->entries.size(), 4);
+  for (const RomEntry &entry : this->entries) {
+    put_uint(out, entry.path.size(), 2);
+    out.insert(out.end(), entry.path.begin(), entry.path.end());
+    put_uint(out, entry.size, 4);
+    put_uint(out, static_cast<uint64_t>(entry.mtime), 8);
+    put_uint(out, entry.hash, 8);
+    put_uint(out, entry.quirks, 1);
+    put_uint(out, entry.runs, 4);
+    put_uint(out, entry.last_cycles, 8);
+    put_uint(out, entry.last_display_hash, 8);
+    put_uint(out, static_cast<uint64_t>(entry.last_seconds * 1e6), 8);
+  }
+
+  std::string temporary = std::string(filename) + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file.is_open()) {
+      std::cerr << "[ERROR] Failed to open " << temporary << std::endl;
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(out.data()), out.size());
+    if (!file) {
+      std::cerr << "[ERROR] Failed to write " << temporary << std::endl;
+      return false;
+    }
+  }
+  std::error_code error;
+  fs::rename(temporary, filename, error);
+  if (error) {
+    std::cerr << "[ERROR] Failed to replace " << filename << ": "
+              << error.message() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+size_t RomLibrary::scan(const std::string &root, unsigned int threads) {
+  this->root = root;
+
+  // Only read while the scan runs, so the workers share it without locking
+  std::unordered_map<std::string, const RomEntry *> known;
+  for (const RomEntry &entry : this->entries)
+    known[entry.path] = &entry;
+
+  std::mutex mutex;
+  std::vector<RomEntry> found;
+  std::atomic<size_t> hashed{0};
+  ThreadPool pool(threads);
+
+  // Each directory is one task and queues a task per subdirectory
+  std::function<void(const fs::path &)> visit = [&](const fs::path &directory) {
+    std::vector<RomEntry> local;
+    std::error_code error;
+    fs::directory_iterator it(directory, error);
+    if (error) {
+      std::cerr << "[ERROR] Failed to read " << directory.string() << ": "
+                << error.message() << std::endl;
+      return;
+    }
+    for (; it != fs::directory_iterator(); it.increment(error)) {
+      const fs::directory_entry &file = *it;
+      std::error_code status;
+      // Symlinked directories are skipped, they can form cycles
+      if (file.is_directory(status) && !file.is_symlink(status)) {
+        fs::path subdirectory = file.path();
+        pool.submit([&visit, subdirectory] { visit(subdirectory); });
+        continue;
+      }
+      if (!file.is_regular_file(status) || !is_rom(file.path()))
+        continue;
+
+      RomEntry entry;
+      entry.path = file.path().lexically_relative(root).generic_string();
+      uint64_t size = file.file_size(status);
+      entry.mtime = file.last_write_time(status).time_since_epoch().count();
+      auto old = known.find(entry.path);
+      if (old != known.end() && old->second->size == size &&
+          old->second->mtime == entry.mtime) {
+        local.push_back(*old->second);
+        continue;
+      }
+
+      // New or changed, the previous run's stats belong to other contents
+      RomFile rom;
+      if (!rom.open(file.path().string().c_str()))
+        continue;
+      entry.size = rom.size();
+      entry.hash = content_hash(rom.data(), rom.size());
+      entry.quirks = RomLibrary::detect_quirks(entry.path.c_str(), rom.data(),
+                                               rom.size());
+      if (old != known.end() && old->second->hash == entry.hash) {
+        entry.runs = old->second->runs;
+        entry.last_cycles = old->second->last_cycles;
+        entry.last_display_hash = old->second->last_display_hash;
+        entry.last_seconds = old->second->last_seconds;
+      }
+      local.push_back(std::move(entry));
+      hashed++;
+    }
+    if (error)
+      std::cerr << "[ERROR] Failed to read " << directory.string() << ": "
+                << error.message() << std::endl;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::move(local.begin(), local.end(), std::back_inserter(found));
+  };
+  fs::path start(root);
+  pool.submit([&visit, start] { visit(start); });
+  pool.wait();
+
+  std::sort(found.begin(), found.end(), by_path);
+  this->entries = std::move(found);
+  return hashed;
+}
+
+const std::vector<RomEntry> &RomLibrary::get_entries() {
+  return this->entries;
+}
+
+std::string RomLibrary::full_path(const RomEntry &entry) {
+  return (fs::path(this->root) / entry.path).string();
+}
+
+RomEntry *RomLibrary::find(const std::string &filename) {
+  // Spelled relative to the root the way scan() saw it, resolving links
+  // through the file system only when that misses
+  fs::path path = fs::path(filename).lexically_normal();
+  std::string relative = path.lexically_relative(this->root).generic_string();
+  auto less = [](const RomEntry &entry, const std::string &path) {
+    return entry.path < path;
+  };
+  auto it = std::lower_bound(this->entries.begin(), this->entries.end(),
+                             relative, less);
+  if (it != this->entries.end() && it->path == relative)
+    return &*it;
+
+  std::error_code error;
+  relative = fs::relative(path, this->root, error).generic_string();
+  if (error || relative.empty())
+    return nullptr;
+  it = std::lower_bound(this->entries.begin(), this->entries.end(), relative,
+                        less);
+  if (it != this->entries.end() && it->path == relative)
+    return &*it;
+  return nullptr;
+}
+
+void RomLibrary::record_run(RomEntry &entry, uint64_t cycles,
+                            uint64_t display_hash, double seconds) {
+  entry.runs++;
+  entry.last_cycles = cycles;
+  entry.last_display_hash = display_hash;
+  entry.last_seconds = seconds;
+}
+
+QuirkProfile RomLibrary::detect_quirks(const char *filename,
+                                       const uint8_t *data, size_t size) {
+  if (quirk_profile_for_rom(filename) == QUIRKS_SCHIP)
+    return QUIRKS_SCHIP;
+
+  // Only reachable code counts, sprite data often looks like anything
+  auto analysis = std::make_unique<RomAnalysis>();
+  if (!analysis->analyze(data, size))
+    return QUIRKS_DEFAULT;
+  uint16_t end = RomAnalysis::program_start_address + size;
+  for (uint16_t address = RomAnalysis::program_start_address; address < end;
+       address++) {
+    if (!(analysis->flags(address) & RomAnalysis::CODE))
+      continue;
+    uint16_t opcode = analysis->opcode(address);
+    uint8_t low = opcode & 0xFF;
+    // 00CN scroll down, 00FB-00FF scrolling, exit and resolution
+    if ((opcode & 0xFFF0) == 0x00C0 || (opcode >= 0x00FB && opcode <= 0x00FF))
+      return QUIRKS_SCHIP;
+    // FX30 big font, FX75 and FX85 flag registers
+    if ((opcode & 0xF000) == 0xF000 &&
+        (low == 0x30 || low == 0x75 || low == 0x85))
+      return QUIRKS_SCHIP;
+  }
+  return QUIRKS_DEFAULT;
+}
@@ -0,0 +1,75 @@
+#ifndef ROM_LIBRARY_H
+#define ROM_LIBRARY_H
+
+#include "quirks.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What the library knows about one rom
+struct RomEntry {
+  // Relative to the library root, '/' separated
+  std::string path;
+  uint32_t size = 0;
+  // File modification time, with size the test for a changed file
+  int64_t mtime = 0;
+  // FNV-1a hash of the contents
+  uint64_t hash = 0;
+  QuirkProfile quirks = QUIRKS_DEFAULT;
+
+  // Last run recorded with record_run()
+  uint32_t runs = 0;
+  uint64_t last_cycles = 0;
+  uint64_t last_display_hash = 0;
+  double last_seconds = 0;
+};
+
+// Index of every rom under a directory tree, kept in a file so later runs
+// only look at what changed. A scan walks the tree on a thread pool, one
+// task per directory, and maps and hashes only the files that are new or
+// whose size or modification time changed since the index was written.
+//
+// Index file layout (little endian): "C8RL" magic, u32 version, u32 entry
+// count, then per entry a u16 path length and the path, u32 size, u64 mtime,
+// u64 hash, u8 quirk profile, u32 runs, u64 last cycles, u64 last display
+// hash and the last run's u64 microseconds.
+class RomLibrary {
+public:
+  static const uint32_t magic_value = 0x4C523843; // "C8RL"
+  static const uint32_t version_value = 1;
+  // Index file name used inside the root unless given another
+  static const char *const default_index_name;
+
+  // A missing file is an empty index, anything unreadable is an error
+  bool load(const char *filename);
+  // Written to a temporary file renamed over filename, so a crash never
+  // leaves half an index
+  bool save(const char *filename);
+
+  // Bring the index up to date with the roms (.ch8, .c8, .sc8) under root,
+  // dropping entries of files that are gone. Zero threads uses one per
+  // hardware thread. Returns how many roms were hashed.
+  size_t scan(const std::string &root, unsigned int threads = 0);
+
+  // Sorted by path
+  const std::vector<RomEntry> &get_entries();
+  // Path of an entry as it can be opened
+  std::string full_path(const RomEntry &entry);
+  // Entry of a rom file under the root (any spelling of its path), nullptr
+  // if it is not indexed
+  RomEntry *find(const std::string &filename);
+  void record_run(RomEntry &entry, uint64_t cycles, uint64_t display_hash,
+                  double seconds);
+
+  // Profile for a rom: SUPER-CHIP for .sc8 files and for roms whose
+  // reachable code uses SUPER-CHIP instructions, the default otherwise
+  static QuirkProfile detect_quirks(const char *filename, const uint8_t *data,
+                                    size_t size);
+
+private:
+  std::string root;
+  std::vector<RomEntry> entries;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "savestate.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<Savestate>::value,
+              "Savestate must be copyable as bytes");
+static_assert(sizeof(Savestate) == 5200, "Savestate must not have padding");
+
+void save_state(CHIP8 &c8, Savestate &state) {
+  state.magic = Savestate::magic_value;
+  state.version = Savestate::version_value;
+
+  state.memory = c8.memory;
+  state.V = c8.V;
+  state.stack = c8.stack;
+  state.opcode = c8.opcode;
+  state.PC = c8.PC;
+  state.SP = c8.SP;
+  state.I = c8.I;
+  state.DT = c8.DT;
+  state.ST = c8.ST;
+  state.rng_state = c8.rng_state;
+  state.keys = c8.keyboard->get_keys();
+  state.reserved[0] = 0;
+
+  const std::vector<uint64_t> &buffer = c8.display->get_buffer();
+  size_t words = std::min<size_t>(buffer.size(), Savestate::max_display_words);
+  state.display_width = c8.display->get_width();
+  state.display_height = c8.display->get_height();
+  std::copy_n(buffer.begin(), words, state.display.begin());
+  std::fill(state.display.begin() + words, state.display.end(), 0);
+}
+
+bool load_state(CHIP8 &c8, const Savestate &state) {
+  if (state.magic != Savestate::magic_value ||
+      state.version != Savestate::version_value) {
+    std::cerr << "[ERROR] Savestate version " << state.version
+              << " is not supported" << std::endl;
+    return false;
+  }
+  if (state.display_width != c8.display->get_width() ||
+      state.display_height != c8.display->get_height()) {
+    std::cerr << "[ERROR] Savestate is for a " << state.display_width << "x"
+              << state.display_height << " display" << std::endl;
+    return false;
+  }
+
+  // Compare a word at a time and only store the bytes that differ
+  for (unsigned int address = 0; address < CHIP8::memory_size; address += 8) {
+    uint64_t current, saved;
+    std::memcpy(&current, &c8.memory[address], 8);
+    std::memcpy(&saved, &state.memory[address], 8);
+    if (current == saved)
+      continue;
+    for (unsigned int byte = address; byte < address + 8; byte++)
+      if (c8.memory[byte] != state.memory[byte])
+        c8.write_memory(byte, state.memory[byte]);
+  }
+
+  c8.V = state.V;
+  c8.stack = state.stack;
+  c8.opcode = state.opcode;
+  c8.PC = state.PC;
+  c8.SP = state.SP;
+  c8.I = state.I;
+  c8.DT = state.DT;
+  c8.ST = state.ST;
+  c8.rng_state = state.rng_state;
+  c8.keyboard->set_keys(state.keys);
+  c8.display->load_buffer(state.display.data(), Savestate::max_display_words);
+  return true;
+}
+
+bool write_savestate(const char *filename, const Savestate &state) {
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+  file.write(reinterpret_cast<const char *>(&state), sizeof(state));
+  if (!file) {
+    std::cerr << "[ERROR] Failed to write " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool read_savestate(const char *filename, Savestate &state) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+  Savestate loaded;
+  file.read(reinterpret_cast<char *>(&loaded), sizeof(loaded));
+  if (file.gcount() != sizeof(loaded) ||
+      loaded.magic != Savestate::magic_value) {
+    std::cerr << "[ERROR] " << filename << " is not a savestate" << std::endl;
+    return false;
+  }
+  if (loaded.version != Savestate::version_value) {
+    std::cerr << "[ERROR] Savestate version " << loaded.version
+              << " is not supported" << std::endl;
+    return false;
+  }
+  state = loaded;
+  return true;
+}
+
+RewindBuffer::RewindBuffer(size_t capacity) {
+  this->capacity = std::max<size_t>(capacity, 1);
+}
+
+void RewindBuffer::push(const Savestate &state) {
+  if (this->empty) {
+    this->oldest = state;
+    this->newest = state;
+    this->empty = false;
+    return;
+  }
+  if (this->capacity == 1) {
+    this->oldest = state;
+    this->newest = state;
+    return;
+  }
+
+  // Reuse the dropped delta's storage when full
+  std::vector<uint8_t> delta;
+  if (this->deltas.size() + 1 >= this->capacity) {
+    delta = std::move(this->deltas.front());
+    this->deltas.pop_front();
+    RewindBuffer::apply(delta, this->oldest);
+    this->encoded_bytes -= delta.size();
+  }
+
+  RewindBuffer::encode(this->newest, state, delta);
+  this->encoded_bytes += delta.size();
+  this->deltas.push_back(std::move(delta));
+  this->newest = state;
+}
+
+bool RewindBuffer::rewind(Savestate &state) {
+  if (this->deltas.empty())
+    return false;
+
+  RewindBuffer::apply(this->deltas.back(), this->newest);
+  this->encoded_bytes -= this->deltas.back().size();
+  this->deltas.pop_back();
+  state = this->newest;
+  return true;
+}
+
+void RewindBuffer::clear() {
+  this->deltas.clear();
+  this->encoded_bytes = 0;
+  this->empty = true;
+}
+
+size_t RewindBuffer::size() {
+  return this->empty ? 0 : this->deltas.size() + 1;
+}
+
+size_t RewindBuffer::get_capacity() { return this->capacity; }
+
+size_t RewindBuffer::delta_bytes() { return this->encoded_bytes; }
+
+void RewindBuffer::encode(const Savestate &a, const Savestate &b,
+                          std::vector<uint8_t> &out) {
+  const uint8_t *x = reinterpret_cast<const uint8_t *>(&a);
+  const uint8_t *y = reinterpret_cast<const uint8_t *>(&b);
+  const size_t size = sizeof(Savestate);
+  out.clear();
+
+  size_t position = 0;
+  while (position < size) {
+    // Skip equal bytes, a word at a time where possible
+    size_t start = position;
+    while (position + 8 <= size &&
+           std::memcmp(x + position, y + position, 8) == 0)
+      position += 8;
+    while (position < size && x[position] == y[position])
+      position++;
+    if (position == size)
+      break;
+    uint16_t zeros = position - start;
+
+    // Literal run ends at the first pair of equal bytes, a single equal byte
+    // costs less inline than a new record
+    size_t literal_start = position;
+    while (position < size &&
+           (x[position] != y[position] ||
+            (position + 1 < size && x[position + 1] != y[position + 1])))
+      position++;
+    uint16_t literals = position - literal_start;
+
+    out.push_back(zeros & 0xFF);
+    out.push_back(zeros >> 8);
+    out.push_back(literals & 0xFF);
+    out.push_back(literals >> 8);
+    for (size_t i = literal_start; i < position; i++)
+      out.push_back(x[i] ^ y[i]);
+  }
+}
+
+void RewindBuffer::apply(const std::vector<uint8_t> &delta, Savestate &state) {
+  uint8_t *bytes = reinterpret_cast<uint8_t *>(&state);
+  size_t position = 0;
+  size_t i = 0;
+  while (i + 4 <= delta.size()) {
+    position += delta[i] | (delta[i + 1] << 8);
+    size_t literals = delta[i + 2] | (delta[i + 3] << 8);
+    i += 4;
+    for (size_t n = 0; n < literals; n++)
+      bytes[position++] ^= delta[i++];
+  }
+}
@@ -0,0 +1,93 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "chip8.hpp"
+#include "display.hpp"
+#include "keyboard.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Complete machine state (CHIP8 registers and memory, Display pixels and the
+// held keys) as one fixed-size block without pointers or padding, so
+// snapshots are plain copies and files are the struct's bytes.
+// Bump version whenever the layout changes.
+struct Savestate {
+  static const uint32_t magic_value = 0x53533843; // "C8SS"
+  static const uint32_t version_value = 2;
+  // Enough packed rows for a 128x64 display
+  static const unsigned int max_display_words = 128;
+
+  uint64_t rng_state;
+  std::array<uint64_t, max_display_words> display;
+  uint32_t magic;
+  uint32_t version;
+  std::array<uint16_t, 16> stack;
+  uint16_t opcode;
+  uint16_t PC;
+  uint16_t I;
+  uint16_t display_width;
+  uint16_t display_height;
+  uint16_t keys;
+  std::array<uint8_t, CHIP8::memory_size> memory;
+  std::array<uint8_t, 16> V;
+  uint8_t SP;
+  uint8_t DT;
+  uint8_t ST;
+  uint8_t reserved[1];
+};
+
+// Copy the machine into state, never allocates
+void save_state(CHIP8 &c8, Savestate &state);
+// Put the machine back into a saved state. Only memory bytes that differ are
+// stored (through write_memory) so cached and translated code stays valid
+// for the rest. Returns false if the state is from another version or
+// display size.
+bool load_state(CHIP8 &c8, const Savestate &state);
+
+// Savestate files hold the struct in host byte order
+bool write_savestate(const char *filename, const Savestate &state);
+bool read_savestate(const char *filename, Savestate &state);
+
+// History of recent states for stepping backwards. The oldest state is kept
+// whole as the keyframe, every later one is stored as the run-length encoded
+// XOR against its predecessor. As XOR is its own inverse the newest state is
+// also kept whole and popping it back walks the chain in reverse, so both
+// ends cost one delta. Mostly unchanged memory makes each delta a few dozen
+// bytes.
+class RewindBuffer {
+public:
+  // capacity is the number of states kept, older ones are dropped
+  explicit RewindBuffer(size_t capacity);
+
+  void push(const Savestate &state);
+  // Remove the newest state and copy the one before it into state, returns
+  // false when there is nothing older to go back to
+  bool rewind(Savestate &state);
+  void clear();
+
+  // States held, including the newest
+  size_t size();
+  size_t get_capacity();
+  // Bytes used by the encoded deltas
+  size_t delta_bytes();
+
+private:
+  // XOR a against b into out as (zero run, literal count, literals) records
+  static void encode(const Savestate &a, const Savestate &b,
+                     std::vector<uint8_t> &out);
+  // XOR an encoded delta into state
+  static void apply(const std::vector<uint8_t> &delta, Savestate &state);
+
+  size_t capacity;
+  bool empty = true;
+  Savestate oldest;
+  Savestate newest;
+  // deltas[i] turns state i into state i + 1 (and back)
+  std::deque<std::vector<uint8_t>> deltas;
+  size_t encoded_bytes = 0;
+};
+
+#endif
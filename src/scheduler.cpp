@@ -0,0 +1,179 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <thread>
+
+Scheduler::Scheduler(CHIP8 *c8, unsigned int cpu_hz) {
+  this->c8 = c8;
+  this->cpu_hz = cpu_hz < Scheduler::timer_hz ? Scheduler::timer_hz : cpu_hz;
+}
+
+void Scheduler::set_cpu_hz(unsigned int cpu_hz) {
+  // Keep the ticks already scheduled, only the ones after now use the new rate
+  this->base_cycle = this->cycles;
+  this->base_tick = this->ticks;
+  this->cpu_hz = cpu_hz < Scheduler::timer_hz ? Scheduler::timer_hz : cpu_hz;
+}
+
+unsigned int Scheduler::get_cpu_hz() { return this->cpu_hz; }
+
+void Scheduler::set_idle_skip(bool idle_skip) { this->idle_skip = idle_skip; }
+
+uint64_t Scheduler::next_tick_cycle() {
+  // Tick k lands on cycle floor(k * cpu_hz / 60), which keeps the timers
+  // exactly at 60Hz even when cpu_hz is not a multiple of 60
+  uint64_t tick = this->ticks - this->base_tick + 1;
+  return this->base_cycle + tick * this->cpu_hz / Scheduler::timer_hz;
+}
+
+void Scheduler::set_input(const std::vector<InputEvent> *events,
+                          Keyboard *keyboard) {
+  this->events = events;
+  this->keyboard = keyboard;
+  this->next_event = 0;
+  if (events == nullptr)
+    return;
+  while (this->next_event < events->size() &&
+         (*events)[this->next_event].cycle < this->cycles)
+    this->next_event++;
+}
+
+void Scheduler::set_tone(ToneSynth *tone) {
+  this->tone = tone;
+  this->c8->set_stop_on_sound_edge(tone != nullptr);
+  this->tone_on = false;
+  this->update_tone();
+}
+
+uint64_t Scheduler::tone_sample(uint64_t cycle) {
+  // Time restarts from the last rate change, like the ticks
+  uint64_t rate = this->tone->get_sample_rate();
+  return this->base_tick * rate / Scheduler::timer_hz +
+         (cycle - this->base_cycle) * rate / this->cpu_hz;
+}
+
+void Scheduler::update_tone() { this->push_tone(this->cycles); }
+
+void Scheduler::push_tone(uint64_t cycle) {
+  if (this->tone == nullptr)
+    return;
+  bool on = this->c8->ST > 0;
+  // A full queue drops the edge, it is retried after the next batch
+  if (on != this->tone_on &&
+      this->tone->push_edge(this->tone_sample(cycle), on))
+    this->tone_on = on;
+}
+
+void Scheduler::set_debugger(Debugger *debugger) { this->debugger = debugger; }
+
+Debugger::Stop Scheduler::get_stop() { return this->stop; }
+
+uint64_t Scheduler::run_checked(uint64_t cycles) {
+  for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+    this->stop = this->debugger->check(*this->c8);
+    if (this->stop != Debugger::NONE)
+      return cycle;
+    this->c8->step();
+    this->push_tone(this->cycles + cycle + 1);
+  }
+  return cycles;
+}
+
+void Scheduler::save(Snapshot &snapshot) {
+  snapshot.cycles = this->cycles;
+  snapshot.ticks = this->ticks;
+  snapshot.base_cycle = this->base_cycle;
+  snapshot.base_tick = this->base_tick;
+  snapshot.cpu_hz = this->cpu_hz;
+  snapshot.tone = this->tone;
+  snapshot.tone_on = this->tone_on;
+}
+
+void Scheduler::restore(const Snapshot &snapshot) {
+  this->cycles = snapshot.cycles;
+  this->ticks = snapshot.ticks;
+  this->base_cycle = snapshot.base_cycle;
+  this->base_tick = snapshot.base_tick;
+  this->cpu_hz = snapshot.cpu_hz;
+  this->tone = snapshot.tone;
+  this->tone_on = snapshot.tone_on;
+  this->c8->set_stop_on_sound_edge(snapshot.tone != nullptr);
+}
+
+void Scheduler::run_cycles(uint64_t cycles) {
+  this->stop = Debugger::NONE;
+  while (cycles > 0 && this->stop == Debugger::NONE) {
+    uint64_t until_tick = this->next_tick_cycle() - this->cycles;
+    uint64_t batch = std::min(cycles, until_tick);
+
+    // Stop the batch at the next key change
+    if (this->events != nullptr) {
+      while (this->next_event < this->events->size() &&
+             (*this->events)[this->next_event].cycle == this->cycles) {
+        this->keyboard->set_keys((*this->events)[this->next_event].keys);
+        this->next_event++;
+      }
+      if (this->next_event < this->events->size())
+        batch = std::min(batch, (*this->events)[this->next_event].cycle -
+                                    this->cycles);
+    }
+    // Cycles spent waiting on FX0A would only repeat it, skip them and let
+    // the timers keep running. Nothing outside the CHIP8 changes within a
+    // batch, so other spin loops can be skipped as well.
+    if (!this->c8->waiting_for_key()) {
+      if (this->debugger != nullptr && this->debugger->armed())
+        batch = this->run_checked(batch);
+      else if (this->idle_skip)
+        batch = this->c8->run_skipping_idle(batch);
+      else
+        batch = this->c8->run(batch);
+    }
+    this->cycles += batch;
+    cycles -= batch;
+    // Only FX18 changes ST inside a batch, and it ends the batch when it does
+    this->push_tone(this->cycles);
+
+    if (this->cycles == this->next_tick_cycle()) {
+      this->c8->tick_timers();
+      this->ticks++;
+      this->push_tone(this->cycles);
+    }
+  }
+  if (this->tone != nullptr)
+    this->tone->advance(this->tone_sample(this->cycles));
+}
+
+void Scheduler::run_frame() { this->run_cycles(this->get_cycles_to_frame()); }
+
+uint64_t Scheduler::get_cycles_to_frame(unsigned int frames) {
+  uint64_t tick = this->ticks - this->base_tick + frames;
+  return this->base_cycle + tick * this->cpu_hz / Scheduler::timer_hz -
+         this->cycles;
+}
+
+uint64_t Scheduler::get_cycles() { return this->cycles; }
+uint64_t Scheduler::get_frames() { return this->ticks; }
+
+FramePacer::FramePacer(double hz) {
+  this->period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / hz));
+  this->deadline = std::chrono::steady_clock::now() + this->period;
+}
+
+void FramePacer::wait() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < this->deadline) {
+    std::this_thread::sleep_until(this->deadline);
+    this->deadline += this->period;
+  } else if (now - this->deadline > this->period) {
+    this->deadline = now + this->period;
+  } else {
+    this->deadline += this->period;
+  }
+}
+
+std::chrono::steady_clock::duration FramePacer::remaining() {
+  auto now = std::chrono::steady_clock::now();
+  if (now >= this->deadline)
+    return std::chrono::steady_clock::duration::zero();
+  return this->deadline - now;
+}
@@ -0,0 +1,124 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "chip8.hpp"
+#include "debugger.hpp"
+#include "input_log.hpp"
+#include "keyboard.hpp"
+#include "tone.hpp"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Runs a CHIP8 at a fixed instruction rate and ticks its delay and sound
+// timers at 60Hz of emulated time, independent of how often the host renders
+class Scheduler {
+public:
+  static const unsigned int timer_hz = 60;
+  static const unsigned int default_cpu_hz = 700;
+
+  explicit Scheduler(CHIP8 *c8, unsigned int cpu_hz = default_cpu_hz);
+
+  // Instructions per emulated second (at least one per timer tick)
+  void set_cpu_hz(unsigned int cpu_hz);
+  unsigned int get_cpu_hz();
+  // Skip iterations of side-effect free spin loops (on by default, results
+  // are the same either way)
+  void set_idle_skip(bool idle_skip);
+
+  // Execute instructions, ticking the timers whenever emulated time crosses
+  // a 60Hz boundary. Returns early when the debugger stops.
+  void run_cycles(uint64_t cycles);
+  // Execute up to and including the next timer tick (one emulated frame)
+  void run_frame();
+  // Instructions left until the next timer tick, or the frames-th one
+  uint64_t get_cycles_to_frame(unsigned int frames = 1);
+
+  // Instructions executed and timer ticks since construction
+  uint64_t get_cycles();
+  uint64_t get_frames();
+
+  // Apply key changes (recorded or live) to keyboard, each one right before
+  // the instruction at its cycle. Events must be sorted by cycle, the ones
+  // before the current cycle are skipped. Pass nullptr to stop.
+  void set_input(const std::vector<InputEvent> *events, Keyboard *keyboard);
+
+  // Send the sound timer's on/off edges (ST > 0) to tone, each stamped with
+  // the cycle it happened on. Timers run out on a tick, which ends a batch,
+  // and while a tone is attached the CHIP8 also ends a batch right after an
+  // FX18 that starts or stops the sound. Pass nullptr to stop.
+  void set_tone(ToneSynth *tone);
+  // Push an edge now if ST changed outside run_cycles (loaded states)
+  void update_tone();
+
+  // Check every instruction against debugger while it has anything armed
+  // (nullptr for none). Costs one test per batch when nothing is armed.
+  void set_debugger(Debugger *debugger);
+  // Why the last run_cycles() returned early, Debugger::NONE if it ran all
+  // its cycles
+  Debugger::Stop get_stop();
+
+  // Emulated time and sound state, saved next to a Savestate to run ahead
+  // and come back
+  struct Snapshot {
+    uint64_t cycles;
+    uint64_t ticks;
+    uint64_t base_cycle;
+    uint64_t base_tick;
+    unsigned int cpu_hz;
+    ToneSynth *tone;
+    bool tone_on;
+  };
+  void save(Snapshot &snapshot);
+  // Go back to a saved position, pushing nothing to the tone
+  void restore(const Snapshot &snapshot);
+
+private:
+  // Cycle at which the next timer tick happens
+  uint64_t next_tick_cycle();
+  // Emulated time of cycle in tone samples
+  uint64_t tone_sample(uint64_t cycle);
+  // Push an edge stamped with cycle if ST changed since the last one
+  void push_tone(uint64_t cycle);
+  // Step up to cycles instructions one at a time through the debugger,
+  // returns how many ran before it stopped (all of them if it did not)
+  uint64_t run_checked(uint64_t cycles);
+
+  CHIP8 *c8;
+  unsigned int cpu_hz;
+  uint64_t cycles = 0;
+  uint64_t ticks = 0;
+  // Cycle and tick count when the rate last changed, later ticks are placed
+  // relative to it
+  uint64_t base_cycle = 0;
+  uint64_t base_tick = 0;
+  bool idle_skip = true;
+  // Replayed input, next_event indexes the first event not applied yet
+  const std::vector<InputEvent> *events = nullptr;
+  Keyboard *keyboard = nullptr;
+  size_t next_event = 0;
+  ToneSynth *tone = nullptr;
+  // Sound state last pushed to tone
+  bool tone_on = false;
+  Debugger *debugger = nullptr;
+  Debugger::Stop stop = Debugger::NONE;
+};
+
+// Sleeps the host thread until the next display refresh deadline
+class FramePacer {
+public:
+  explicit FramePacer(double hz = Scheduler::timer_hz);
+
+  // Block until the current frame's deadline, then advance it by one period.
+  // When running more than a frame late the schedule restarts from now
+  // instead of trying to catch up.
+  void wait();
+  // Time left until the current deadline (zero when late)
+  std::chrono::steady_clock::duration remaining();
+
+private:
+  std::chrono::steady_clock::duration period;
+  std::chrono::steady_clock::time_point deadline;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. capacity must be a power of two.
+template <typename T, size_t capacity> class SpscQueue {
+  static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0,
+                "capacity must be a power of two");
+
+public:
+  // Producer: returns false (dropping value) when the queue is full
+  bool push(const T &value) {
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail - this->head.load(std::memory_order_acquire) == capacity)
+      return false;
+    this->slots[tail & (capacity - 1)] = value;
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer: returns false when the queue is empty
+  bool pop(T &value) {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    if (head == this->tail.load(std::memory_order_acquire))
+      return false;
+    value = this->slots[head & (capacity - 1)];
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::array<T, capacity> slots{};
+  // Kept on separate cache lines so the two threads do not share one
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "thread_pool.hpp"
+
+namespace {
+// Index of the pool worker running on this thread, or -1 outside the pool
+thread_local int current_worker = -1;
+thread_local const ThreadPool *current_pool = nullptr;
+} // namespace
+
+ThreadPool::ThreadPool(unsigned int threads) {
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if (threads == 0)
+    threads = 1;
+
+  for (unsigned int i = 0; i < threads; i++)
+    this->workers.push_back(std::make_unique<Worker>());
+  for (unsigned int i = 0; i < threads; i++)
+    this->threads.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->state_mutex);
+    this->stopping = true;
+  }
+  this->work_available.notify_all();
+  for (std::thread &thread : this->threads)
+    thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  unsigned int index;
+  if (current_pool == this)
+    index = current_worker;
+  else
+    index = this->next_worker++ % this->workers.size();
+
+  {
+    std::lock_guard<std::mutex> lock(this->workers[index]->mutex);
+    this->workers[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->state_mutex);
+    this->queued++;
+    this->pending++;
+  }
+  this->work_available.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(this->state_mutex);
+  this->all_done.wait(lock, [this] { return this->pending == 0; });
+}
+
+unsigned int ThreadPool::size() { return this->workers.size(); }
+
+bool ThreadPool::take(unsigned int index, std::function<void()> &task) {
+  // Own deque first, newest task (still warm in cache)
+  {
+    Worker &own = *this->workers[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  // Then steal the oldest task of the next worker that has one
+  for (size_t i = 1; i < this->workers.size(); i++) {
+    Worker &victim = *this->workers[(index + i) % this->workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::work(unsigned int index) {
+  current_worker = index;
+  current_pool = this;
+
+  while (true) {
+    std::function<void()> task;
+    if (this->take(index, task)) {
+      {
+        std::lock_guard<std::mutex> lock(this->state_mutex);
+        this->queued--;
+      }
+      task();
+
+      std::lock_guard<std::mutex> lock(this->state_mutex);
+      if (--this->pending == 0)
+        this->all_done.notify_all();
+      continue;
+    }
+
+    // Nothing to run or steal, sleep until a task is submitted
+    std::unique_lock<std::mutex> lock(this->state_mutex);
+    this->work_available.wait(
+        lock, [this] { return this->stopping || this->queued > 0; });
+    if (this->stopping && this->queued == 0)
+      return;
+  }
+}
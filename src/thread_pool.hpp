@@ -0,0 +1,53 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. Workers run their
+// own tasks newest first and steal the oldest task from another worker when
+// they run out, so uneven task lengths still keep every core busy.
+class ThreadPool {
+public:
+  // Zero threads uses one per hardware thread
+  explicit ThreadPool(unsigned int threads = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Queue a task, tasks submitted from a worker go to that worker's deque
+  void submit(std::function<void()> task);
+  // Block until every submitted task has finished
+  void wait();
+  unsigned int size();
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void work(unsigned int index);
+  bool take(unsigned int index, std::function<void()> &task);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::atomic<unsigned int> next_worker{0};
+
+  std::mutex state_mutex;
+  std::condition_variable work_available;
+  std::condition_variable all_done;
+  // Tasks sitting in deques and tasks not yet finished
+  size_t queued = 0;
+  size_t pending = 0;
+  bool stopping = false;
+};
+
+#endif
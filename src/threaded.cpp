@@ -0,0 +1,388 @@
+#include "chip8.hpp"
+#include "display.hpp"
+#include "keyboard.hpp"
+#include <array>
+
+// GCC and Clang can take the address of a label, so every handler ends in its
+// own indirect jump to the next one. Other compilers loop over a switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define THREADED_COMPUTED_GOTO 1
+#else
+#define THREADED_COMPUTED_GOTO 0
+#endif
+
+namespace {
+// One handler per instruction, in the order of the reference switch in
+// CHIP8::interpret()
+enum Handler : uint8_t {
+  H_0NNN, // SYS and anything else that does nothing
+  H_00E0,
+  H_00EE,
+  H_1NNN,
+  H_2NNN,
+  H_3XNN,
+  H_4XNN,
+  H_5XY0,
+  H_6XNN,
+  H_7XNN,
+  H_8XY0,
+  H_8XY1,
+  H_8XY2,
+  H_8XY3,
+  H_8XY4,
+  H_8XY5,
+  H_8XY6,
+  H_8XY7,
+  H_8XYE,
+  H_9XY0,
+  H_ANNN,
+  H_BNNN,
+  H_CXNN,
+  H_DXYN,
+  H_EX9E,
+  H_EXA1,
+  H_FX07,
+  H_FX0A,
+  H_FX15,
+  H_FX18,
+  H_FX1E,
+  H_FX29,
+  H_FX33,
+  H_FX55,
+  H_FX65,
+  HANDLER_COUNT
+};
+
+// The top nibble and the low byte tell every instruction apart (the 8XYN
+// family by the low nibble of its low byte), so the table has 16 * 256
+// entries rather than one per opcode and stays in L1
+constexpr unsigned int table_index(uint16_t opcode) {
+  return ((opcode >> 12) << 8) | (opcode & 0x00FF);
+}
+
+constexpr Handler handler_for(uint16_t opcode) {
+  uint8_t N = opcode & 0x000F;
+  uint8_t NN = opcode & 0x00FF;
+  switch (opcode >> 12) {
+  case 0x0:
+    return NN == 0xE0 ? H_00E0 : NN == 0xEE ? H_00EE : H_0NNN;
+  case 0x1:
+    return H_1NNN;
+  case 0x2:
+    return H_2NNN;
+  case 0x3:
+    return H_3XNN;
+  case 0x4:
+    return H_4XNN;
+  case 0x5:
+    return H_5XY0;
+  case 0x6:
+    return H_6XNN;
+  case 0x7:
+    return H_7XNN;
+  case 0x8:
+    switch (N) {
+    case 0x0:
+      return H_8XY0;
+    case 0x1:
+      return H_8XY1;
+    case 0x2:
+      return H_8XY2;
+    case 0x3:
+      return H_8XY3;
+    case 0x4:
+      return H_8XY4;
+    case 0x5:
+      return H_8XY5;
+    case 0x6:
+      return H_8XY6;
+    case 0x7:
+      return H_8XY7;
+    case 0xE:
+      return H_8XYE;
+    default:
+      return H_0NNN;
+    }
+  case 0x9:
+    return H_9XY0;
+  case 0xA:
+    return H_ANNN;
+  case 0xB:
+    return H_BNNN;
+  case 0xC:
+    return H_CXNN;
+  case 0xD:
+    return H_DXYN;
+  case 0xE:
+    return NN == 0x9E ? H_EX9E : NN == 0xA1 ? H_EXA1 : H_0NNN;
+  default:
+    switch (NN) {
+    case 0x07:
+      return H_FX07;
+    case 0x0A:
+      return H_FX0A;
+    case 0x15:
+      return H_FX15;
+    case 0x18:
+      return H_FX18;
+    case 0x1E:
+      return H_FX1E;
+    case 0x29:
+      return H_FX29;
+    case 0x33:
+      return H_FX33;
+    case 0x55:
+      return H_FX55;
+    case 0x65:
+      return H_FX65;
+    default:
+      return H_0NNN;
+    }
+  }
+}
+
+constexpr std::array<uint8_t, 16 * 256> make_handler_table() {
+  std::array<uint8_t, 16 * 256> table{};
+  for (unsigned int T = 0; T < 16; T++)
+    for (unsigned int NN = 0; NN < 256; NN++)
+      table[(T << 8) | NN] = handler_for((T << 12) | NN);
+  return table;
+}
+
+constexpr std::array<uint8_t, 16 * 256> handler_table = make_handler_table();
+
+static_assert(handler_table[table_index(0x00E0)] == H_00E0 &&
+                  handler_table[table_index(0x8AB6)] == H_8XY6 &&
+                  handler_table[table_index(0xF265)] == H_FX65 &&
+                  handler_table[table_index(0xE1A2)] == H_0NNN,
+              "handler table out of step with handler_for");
+} // namespace
+
+template <QuirkProfile P> uint64_t CHIP8::run_threaded(uint64_t cycles) {
+  const uint64_t requested = cycles;
+  constexpr Quirks quirks = quirks_for(P);
+  // Operands of the current instruction, see CHIP8::interpret()
+  uint8_t X = 0, Y = 0, N = 0, NN = 0;
+  uint16_t NNN = 0;
+  unsigned int flag;
+  Key pressed_key;
+  PROFILE_HOOK(uint16_t profile_pc = 0;)
+
+  // Past 0xFFE nothing executes any more, so the remaining cycles can go
+  if (cycles == 0 || this->PC >= 0xFFF)
+    return requested;
+
+// Fetch the instruction at PC, move PC past it and split out the operands
+#define FETCH()                                                                \
+  PROFILE_HOOK(profile_pc = this->PC;)                                         \
+  this->opcode = (this->memory[this->PC] << 8) | this->memory[this->PC + 1];   \
+  this->PC += 2;                                                               \
+  X = (this->opcode & 0x0F00) >> 8;                                            \
+  Y = (this->opcode & 0x00F0) >> 4;                                            \
+  N = this->opcode & 0x000F;                                                   \
+  NN = this->opcode & 0x00FF;                                                  \
+  NNN = this->opcode & 0x0FFF
+
+#if THREADED_COMPUTED_GOTO
+  // Same order as Handler
+  static const void *const targets[HANDLER_COUNT] = {
+      &&L_0NNN, &&L_00E0, &&L_00EE, &&L_1NNN, &&L_2NNN, &&L_3XNN, &&L_4XNN,
+      &&L_5XY0, &&L_6XNN, &&L_7XNN, &&L_8XY0, &&L_8XY1, &&L_8XY2, &&L_8XY3,
+      &&L_8XY4, &&L_8XY5, &&L_8XY6, &&L_8XY7, &&L_8XYE, &&L_9XY0, &&L_ANNN,
+      &&L_BNNN, &&L_CXNN, &&L_DXYN, &&L_EX9E, &&L_EXA1, &&L_FX07, &&L_FX0A,
+      &&L_FX15, &&L_FX18, &&L_FX1E, &&L_FX29, &&L_FX33, &&L_FX55, &&L_FX65};
+#define HANDLER(name) L_##name:
+  // Every handler dispatches the next instruction itself, giving the branch
+  // predictor one indirect jump per handler to learn instead of a shared one
+#define NEXT()                                                                 \
+  do {                                                                         \
+    PROFILE_HOOK(                                                              \
+        this->profile.executed(profile_pc, this->opcode, this->PC);)           \
+    if (--cycles == 0 || this->PC >= 0xFFF)                                    \
+      return requested;                                                        \
+    FETCH();                                                                   \
+    goto *targets[handler_table[table_index(this->opcode)]];                   \
+  } while (0)
+
+  FETCH();
+  goto *targets[handler_table[table_index(this->opcode)]];
+  {
+#else
+#define HANDLER(name) case H_##name:
+#define NEXT()                                                                 \
+  PROFILE_HOOK(this->profile.executed(profile_pc, this->opcode, this->PC);)    \
+  continue
+
+  for (; cycles > 0 && this->PC < 0xFFF; cycles--) {
+    FETCH();
+    switch (handler_table[table_index(this->opcode)]) {
+    default:
+#endif
+
+    HANDLER(0NNN)
+      NEXT();
+    HANDLER(00E0)
+      this->display->clear_buffer();
+      NEXT();
+    HANDLER(00EE)
+      this->PC = this->stack[this->SP--];
+      NEXT();
+    HANDLER(1NNN)
+      this->PC = NNN;
+      NEXT();
+    HANDLER(2NNN)
+      this->stack[++this->SP] = this->PC;
+      this->PC = NNN;
+      NEXT();
+    HANDLER(3XNN)
+      if (this->V[X] == NN)
+        this->PC += 2;
+      NEXT();
+    HANDLER(4XNN)
+      if (this->V[X] != NN)
+        this->PC += 2;
+      NEXT();
+    HANDLER(5XY0)
+      if (this->V[X] == this->V[Y])
+        this->PC += 2;
+      NEXT();
+    HANDLER(6XNN)
+      this->V[X] = NN;
+      NEXT();
+    HANDLER(7XNN)
+      this->V[X] += NN;
+      NEXT();
+    HANDLER(8XY0)
+      this->V[X] = this->V[Y];
+      NEXT();
+    HANDLER(8XY1)
+      this->V[X] |= this->V[Y];
+      if constexpr (quirks.reset_vf)
+        this->V[0xF] = 0;
+      NEXT();
+    HANDLER(8XY2)
+      this->V[X] &= this->V[Y];
+      if constexpr (quirks.reset_vf)
+        this->V[0xF] = 0;
+      NEXT();
+    HANDLER(8XY3)
+      this->V[X] ^= this->V[Y];
+      if constexpr (quirks.reset_vf)
+        this->V[0xF] = 0;
+      NEXT();
+    HANDLER(8XY4)
+      flag = (uint16_t)this->V[X] + (uint16_t)this->V[Y] > 0xFF ? 1 : 0;
+      this->V[X] += this->V[Y];
+      this->V[0xF] = flag;
+      NEXT();
+    HANDLER(8XY5)
+      flag = this->V[X] >= this->V[Y] ? 1 : 0;
+      this->V[X] -= this->V[Y];
+      this->V[0xF] = flag;
+      NEXT();
+    HANDLER(8XY6)
+      if constexpr (quirks.shift_vy)
+        this->V[X] = this->V[Y];
+      flag = this->V[X] & 0b1;
+      this->V[X] >>= 1;
+      this->V[0xF] = flag;
+      NEXT();
+    HANDLER(8XY7)
+      flag = this->V[Y] >= this->V[X] ? 1 : 0;
+      this->V[X] = this->V[Y] - this->V[X];
+      this->V[0xF] = flag;
+      NEXT();
+    HANDLER(8XYE)
+      if constexpr (quirks.shift_vy)
+        this->V[X] = this->V[Y];
+      flag = (this->V[X] >> 7) & 0b1;
+      this->V[X] <<= 1;
+      this->V[0xF] = flag;
+      NEXT();
+    HANDLER(9XY0)
+      if (this->V[X] != this->V[Y])
+        this->PC += 2;
+      NEXT();
+    HANDLER(ANNN)
+      this->I = NNN;
+      NEXT();
+    HANDLER(BNNN)
+      this->PC = NNN + this->V[quirks.jump_vx ? X : 0x0];
+      NEXT();
+    HANDLER(CXNN)
+      this->V[X] = this->random_byte() & NN;
+      NEXT();
+    HANDLER(DXYN)
+      this->draw_sprite(X, Y, N, !quirks.clip_sprites);
+      NEXT();
+    HANDLER(EX9E)
+      if (this->keyboard->is_pressed(this->V[X]))
+        this->PC += 2;
+      NEXT();
+    HANDLER(EXA1)
+      if (!this->keyboard->is_pressed(this->V[X]))
+        this->PC += 2;
+      NEXT();
+    HANDLER(FX07)
+      this->V[X] = this->DT;
+      NEXT();
+    HANDLER(FX0A)
+      pressed_key = this->keyboard->get_pressed_key();
+      if (pressed_key != Key::NONE)
+        this->V[X] = pressed_key;
+      else
+        this->PC -= 2;
+      NEXT();
+    HANDLER(FX15)
+      this->DT = this->V[X];
+      NEXT();
+    HANDLER(FX18)
+      this->set_sound_timer(this->V[X]);
+      // cycles still counts this instruction
+      if (this->sound_edge) {
+        PROFILE_HOOK(
+            this->profile.executed(profile_pc, this->opcode, this->PC);)
+        return requested - cycles + 1;
+      }
+      NEXT();
+    HANDLER(FX1E)
+      this->I += this->V[X];
+      NEXT();
+    HANDLER(FX29)
+      this->I = this->memory[CHIP8::fontset_start_address + 5 * this->V[X]];
+      NEXT();
+    HANDLER(FX33)
+      this->write_memory(this->I, this->V[X] / 100);
+      this->write_memory(this->I + 1, (this->V[X] % 100) / 10);
+      this->write_memory(this->I + 2, this->V[X] % 10);
+      NEXT();
+    HANDLER(FX55)
+      for (int x = 0; x <= X; x++)
+        this->write_memory(this->I + x, this->V[x]);
+      if constexpr (quirks.memory_index == ADVANCE_I_BY_X)
+        this->I += X;
+      else if constexpr (quirks.memory_index == ADVANCE_I_PAST_X)
+        this->I += X + 1;
+      NEXT();
+    HANDLER(FX65)
+      for (int x = 0; x <= X; x++)
+        this->V[x] = this->memory[this->I + x];
+      if constexpr (quirks.memory_index == ADVANCE_I_BY_X)
+        this->I += X;
+      else if constexpr (quirks.memory_index == ADVANCE_I_PAST_X)
+        this->I += X + 1;
+      NEXT();
+#if !THREADED_COMPUTED_GOTO
+    }
+#endif
+  }
+#undef FETCH
+#undef HANDLER
+#undef NEXT
+  return requested;
+}
+
+template uint64_t CHIP8::run_threaded<QUIRKS_DEFAULT>(uint64_t cycles);
+template uint64_t CHIP8::run_threaded<QUIRKS_VIP>(uint64_t cycles);
+template uint64_t CHIP8::run_threaded<QUIRKS_CHIP48>(uint64_t cycles);
+template uint64_t CHIP8::run_threaded<QUIRKS_SCHIP>(uint64_t cycles);
@@ -0,0 +1,82 @@
+#include "tone.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Peak amplitude of the square wave
+static const float volume = 0.25f;
+
+// PolyBLEP residual of a unit step at phase 0 for a wave advancing dt per
+// sample, subtracting it from a naive square removes most of its aliasing
+static double poly_blep(double t, double dt) {
+  if (t < dt) {
+    t /= dt;
+    return t + t - t * t - 1.0;
+  }
+  if (t > 1.0 - dt) {
+    t = (t - 1.0) / dt;
+    return t * t + t + t + 1.0;
+  }
+  return 0.0;
+}
+
+ToneSynth::ToneSynth(unsigned int sample_rate, unsigned int delay) {
+  this->sample_rate = std::max(1u, sample_rate);
+  this->delay = delay > 0 ? delay : this->sample_rate / 60;
+  this->ramp = std::max(1u, this->sample_rate / 1000);
+  this->max_drift = this->sample_rate / 60;
+  this->increment = static_cast<double>(ToneSynth::frequency) /
+                    static_cast<double>(this->sample_rate);
+}
+
+bool ToneSynth::push_edge(uint64_t sample, bool on) {
+  return this->edges.push({sample, on});
+}
+
+void ToneSynth::advance(uint64_t sample) {
+  this->produced.store(sample, std::memory_order_release);
+}
+
+void ToneSynth::render(float *out, size_t count) {
+  // Stay delay samples behind the emulator, jumping back into place when the
+  // two clocks have drifted apart. Edges that are overdue after a jump are
+  // applied right away, in order.
+  uint64_t produced = this->produced.load(std::memory_order_acquire);
+  if (!this->synced ||
+      this->clock + this->delay + this->max_drift < produced ||
+      this->clock > produced + this->max_drift) {
+    this->clock = produced > this->delay ? produced - this->delay : 0;
+    this->synced = true;
+  }
+
+  const float step = 1.0f / this->ramp;
+  for (size_t i = 0; i < count; i++, this->clock++) {
+    while (true) {
+      if (!this->has_next)
+        this->has_next = this->edges.pop(this->next);
+      if (!this->has_next || this->next.sample > this->clock)
+        break;
+      this->on = this->next.on;
+      this->has_next = false;
+    }
+
+    if (this->on)
+      this->gain = std::min(1.0f, this->gain + step);
+    else
+      this->gain = std::max(0.0f, this->gain - step);
+    if (this->gain == 0.0f) {
+      // Every beep starts from the same phase
+      this->phase = 0.0;
+      out[i] = 0.0f;
+      continue;
+    }
+
+    double t = this->phase;
+    double value = t < 0.5 ? 1.0 : -1.0;
+    value += poly_blep(t, this->increment);
+    value -= poly_blep(std::fmod(t + 0.5, 1.0), this->increment);
+    this->phase += this->increment;
+    if (this->phase >= 1.0)
+      this->phase -= 1.0;
+    out[i] = volume * this->gain * static_cast<float>(value);
+  }
+}
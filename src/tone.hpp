@@ -0,0 +1,66 @@
+#ifndef TONE_H
+#define TONE_H
+
+#include "spsc_queue.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// The CHIP-8 buzzer: a band-limited square wave gated by sound timer edges.
+// The emulation thread pushes each on/off edge stamped with the emulated
+// sample it happens at through a lock-free queue, the audio thread renders
+// them a fixed delay behind the emulator. The emulator produces a whole
+// frame at once, so delaying playback by one frame keeps every edge at its
+// exact distance from the previous one. Rendering never locks or allocates.
+class ToneSynth {
+public:
+  static const unsigned int default_sample_rate = 48000;
+  static const unsigned int frequency = 440;
+  // Edges in flight between the threads
+  static const size_t queue_size = 1024;
+
+  // delay is in samples, 0 picks one 60Hz frame
+  explicit ToneSynth(unsigned int sample_rate = default_sample_rate,
+                     unsigned int delay = 0);
+
+  // Emulation thread: sound turns on or off at sample (counted from the
+  // start of emulation). Returns false and drops the edge when the queue is
+  // full.
+  bool push_edge(uint64_t sample, bool on);
+  // Emulation thread: everything before sample has been emulated
+  void advance(uint64_t sample);
+
+  // Audio thread: write count mono samples to out
+  void render(float *out, size_t count);
+
+  unsigned int get_sample_rate() const { return this->sample_rate; }
+
+private:
+  struct Edge {
+    uint64_t sample;
+    bool on;
+  };
+
+  unsigned int sample_rate;
+  unsigned int delay;
+  // Samples an edge's gain change is spread over, hard switches click
+  unsigned int ramp;
+  // Playback resyncs when it drifts further than this from delay behind
+  // the emulator (pauses, turbo, rewinding)
+  unsigned int max_drift;
+
+  SpscQueue<Edge, queue_size> edges;
+  std::atomic<uint64_t> produced{0};
+
+  // Audio thread state, clock is the emulated sample being rendered
+  uint64_t clock = 0;
+  bool synced = false;
+  Edge next{};
+  bool has_next = false;
+  bool on = false;
+  float gain = 0.0f;
+  double phase = 0.0;
+  double increment;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single writer, single reader hand-off of the latest value.
+// The writer fills back() and publishes it, the reader picks up whatever
+// was published last and reads it from front(). Neither side ever waits:
+// the third slot sits in the middle between them and publishing or picking
+// up is one atomic exchange with it. Values published while the reader is
+// busy are overwritten, the reader only ever sees the newest.
+template <typename T> class TripleBuffer {
+public:
+  // Every slot starts as a copy of initial, so containers inside T can be
+  // sized once up front and reused without allocating
+  explicit TripleBuffer(const T &initial = T())
+      : slots{initial, initial, initial} {}
+  TripleBuffer(const TripleBuffer &) = delete;
+  TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+  // Writer: the slot to fill next
+  T &back() { return this->slots[this->back_index]; }
+  // Writer: make back() the newest value and get a free slot to fill
+  void publish() {
+    uint8_t previous = this->middle.exchange(this->back_index | fresh_bit,
+                                             std::memory_order_acq_rel);
+    this->back_index = previous & index_mask;
+  }
+
+  // Reader: switch front() to the newest published value, returns false
+  // (and keeps the current one) if nothing new was published
+  bool update() {
+    if ((this->middle.load(std::memory_order_relaxed) & fresh_bit) == 0)
+      return false;
+    uint8_t previous =
+        this->middle.exchange(this->front_index, std::memory_order_acq_rel);
+    this->front_index = previous & index_mask;
+    return true;
+  }
+  // Reader: the value picked up by the last update()
+  const T &front() { return this->slots[this->front_index]; }
+
+private:
+  static const uint8_t index_mask = 0x3;
+  // Set in middle when it holds a value the reader has not picked up yet
+  static const uint8_t fresh_bit = 0x4;
+
+  T slots[3];
+  // Owned by the writer and the reader respectively
+  uint8_t back_index = 0;
+  uint8_t front_index = 1;
+  std::atomic<uint8_t> middle{2};
+};
+
+#endif
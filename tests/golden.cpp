@@ -0,0 +1,267 @@
+#include "chip8.hpp"
+#include "display.hpp"
+#include "input_log.hpp"
+#include "keyboard.hpp"
+#include "scheduler.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define DISPLAY_WIDTH 64
+#define DISPLAY_HEIGHT 32
+
+// Runs a rom headlessly at full speed and compares display hashes at fixed
+// frames against a golden file. Golden files are text, one directive per
+// line ('#' starts a comment):
+//
+//   hz N               instructions per second (default 700)
+//   seed N             random seed (default CHIP8::default_seed)
+//   quirks NAME        quirk profile (default from the rom's file name)
+//   key CYCLE K...     hold exactly the hex keys K (or '-' for none) from
+//                      CYCLE on
+//   check FRAME HASH   display hash after FRAME timer ticks
+//
+// --quirks overrides the file's profile, so one rom can have a golden per
+// profile. --update rewrites the check lines with the hashes of this run.
+struct Golden {
+  unsigned int cpu_hz = Scheduler::default_cpu_hz;
+  uint64_t seed = CHIP8::default_seed;
+  QuirkProfile quirks = QUIRKS_DEFAULT;
+  bool quirks_given = false;
+  std::vector<InputEvent> events;
+  struct Check {
+    uint64_t frame;
+    uint64_t hash;
+  };
+  std::vector<Check> checks;
+  // Every line but the checks, kept for --update
+  std::vector<std::string> header;
+};
+
+static void print_usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " <rom> <golden> [--engine interpreter|cached|jit|threaded]"
+               " [--quirks default|vip|chip48|schip] [--no-idle-skip]"
+               " [--dump DIR] [--update]"
+            << std::endl;
+}
+
+static bool read_golden(const char *filename, Golden &golden) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  for (unsigned int number = 1; std::getline(file, line); number++) {
+    std::istringstream words(line);
+    std::string directive;
+    words >> directive;
+    if (directive != "check")
+      golden.header.push_back(line);
+    if (directive.empty() || directive[0] == '#')
+      continue;
+
+    bool ok = true;
+    if (directive == "hz") {
+      ok = static_cast<bool>(words >> golden.cpu_hz);
+    } else if (directive == "seed") {
+      ok = static_cast<bool>(words >> golden.seed);
+    } else if (directive == "quirks") {
+      std::string name;
+      ok = static_cast<bool>(words >> name) &&
+           parse_quirk_profile(name.c_str(), golden.quirks);
+      golden.quirks_given = true;
+    } else if (directive == "key") {
+      uint64_t cycle;
+      std::string key;
+      uint16_t keys = 0;
+      ok = static_cast<bool>(words >> cycle >> key);
+      if (ok && key != "-") {
+        do {
+          char *end;
+          unsigned long value = std::strtoul(key.c_str(), &end, 16);
+          ok = ok && *end == '\0' && value <= 0xF;
+          keys |= 1u << (value & 0xF);
+        } while (words >> key);
+      }
+      golden.events.push_back({cycle, keys});
+    } else if (directive == "check") {
+      Golden::Check check;
+      ok = static_cast<bool>(words >> check.frame >> std::hex >> check.hash);
+      golden.checks.push_back(check);
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "[ERROR] " << filename << ":" << number
+                << ": malformed line: " << line << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool write_golden(const char *filename, const Golden &golden) {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+  for (const std::string &line : golden.header)
+    file << line << "\n";
+  for (const Golden::Check &check : golden.checks)
+    file << "check " << check.frame << " " << std::hex << check.hash
+         << std::dec << "\n";
+  return static_cast<bool>(file);
+}
+
+// Binary PGM, lit pixels white
+static bool write_pgm(const std::string &filename, Display &display) {
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "[ERROR] Failed to open " << filename << std::endl;
+    return false;
+  }
+  file << "P5\n" << display.get_width() << " " << display.get_height()
+       << "\n255\n";
+  for (unsigned int y = 0; y < display.get_height(); y++)
+    for (unsigned int x = 0; x < display.get_width(); x++)
+      file.put(display.get_pixel(x, y) ? static_cast<char>(255) : 0);
+  return static_cast<bool>(file);
+}
+
+// File name without directories and extension
+static std::string stem(const char *path) {
+  std::string name(path);
+  size_t slash = name.find_last_of("/\\");
+  if (slash != std::string::npos)
+    name = name.substr(slash + 1);
+  size_t dot = name.find_last_of('.');
+  if (dot != std::string::npos && dot > 0)
+    name = name.substr(0, dot);
+  return name;
+}
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr;
+  const char *golden_path = nullptr;
+  const char *engine_name = "interpreter";
+  Engine engine = Engine::INTERPRETER;
+  QuirkProfile quirks = QUIRKS_DEFAULT;
+  bool quirks_given = false;
+  bool idle_skip = true;
+  const char *dump = nullptr;
+  bool update = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      engine_name = argv[++i];
+      if (std::strcmp(engine_name, "interpreter") == 0) {
+        engine = Engine::INTERPRETER;
+      } else if (std::strcmp(engine_name, "cached") == 0) {
+        engine = Engine::CACHED;
+      } else if (std::strcmp(engine_name, "jit") == 0) {
+        engine = Engine::JIT;
+      } else if (std::strcmp(engine_name, "threaded") == 0) {
+        engine = Engine::THREADED;
+      } else {
+        std::cerr << "[ERROR] Unknown engine: " << engine_name << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+      if (!parse_quirk_profile(argv[++i], quirks)) {
+        std::cerr << "[ERROR] Unknown quirk profile: " << argv[i] << std::endl;
+        return 1;
+      }
+      quirks_given = true;
+    } else if (std::strcmp(argv[i], "--no-idle-skip") == 0) {
+      idle_skip = false;
+    } else if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+      dump = argv[++i];
+    } else if (std::strcmp(argv[i], "--update") == 0) {
+      update = true;
+    } else if (argv[i][0] != '-' && rom == nullptr) {
+      rom = argv[i];
+    } else if (argv[i][0] != '-' && golden_path == nullptr) {
+      golden_path = argv[i];
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (rom == nullptr || golden_path == nullptr) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  Golden golden;
+  if (!read_golden(golden_path, golden))
+    return 1;
+  if (golden.checks.empty()) {
+    std::cerr << "[ERROR] " << golden_path << " has no check lines"
+              << std::endl;
+    return 1;
+  }
+  if (quirks_given) {
+    golden.quirks = quirks;
+    golden.quirks_given = true;
+  }
+  // Dumps and messages name the profile when one is set explicitly
+  std::string name = stem(rom);
+  if (golden.quirks_given)
+    name += std::string(".") + quirk_profile_name(golden.quirks);
+
+  Display display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+  Keyboard keyboard;
+  CHIP8 c8(&display, &keyboard);
+  c8.set_engine(engine);
+  c8.set_quirks(golden.quirks_given ? golden.quirks
+                                    : quirk_profile_for_rom(rom));
+  c8.seed_random(golden.seed);
+  if (!c8.load_rom(rom))
+    return 1;
+
+  Scheduler scheduler(&c8, golden.cpu_hz);
+  scheduler.set_idle_skip(idle_skip);
+  scheduler.set_input(&golden.events, &keyboard);
+
+  // Checks are visited in file order, each one runs on from the previous
+  unsigned int failures = 0;
+  for (Golden::Check &check : golden.checks) {
+    while (scheduler.get_frames() < check.frame)
+      scheduler.run_frame();
+
+    uint64_t hash = display.hash();
+    if (update) {
+      check.hash = hash;
+    } else if (hash != check.hash) {
+      failures++;
+      std::cerr << "[ERROR] " << name << " on " << engine_name
+                << ": frame " << check.frame << " hash " << std::hex << hash
+                << ", expected " << check.hash << std::dec << std::endl;
+      if (dump != nullptr) {
+        std::string filename = std::string(dump) + "/" + name + "." +
+                               engine_name + ".frame" +
+                               std::to_string(check.frame) + ".pgm";
+        if (write_pgm(filename, display))
+          std::cerr << "[INFO] Wrote " << filename << std::endl;
+      }
+    }
+  }
+
+  if (update)
+    return write_golden(golden_path, golden) ? 0 : 1;
+  std::cout << "[INFO] " << name << " on " << engine_name << ": "
+            << golden.checks.size() - failures << "/" << golden.checks.size()
+            << " checks passed" << std::endl;
+  return failures == 0 ? 0 : 1;
+}
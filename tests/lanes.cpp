@@ -0,0 +1,151 @@
+#include "chip8.hpp"
+#include "display.hpp"
+#include "keyboard.hpp"
+#include "lanes.hpp"
+#include "rom_file.hpp"
+#include "scheduler.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Runs a rom on every lane of a LaneEngine and on one scalar CHIP8 per lane
+// side by side, comparing registers, stack, memory and display after every
+// frame. Each lane gets its own seed and key pattern so the lanes diverge
+// and the grouping of differing opcodes is exercised too.
+
+// One scalar reference machine
+struct Reference {
+  Display display{LaneEngine::display_width, LaneEngine::display_height};
+  Keyboard keyboard;
+  CHIP8 c8{&display, &keyboard};
+};
+
+static void print_usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " <rom> [--quirks default|vip|chip48|schip] [--lanes N]"
+               " [--frames N] [--hz N]"
+            << std::endl;
+}
+
+// Keys lane holds during frame: one key at a time, changing every 10 frames
+// with gaps where none is held
+static uint16_t lane_keys(unsigned int lane, uint64_t frame) {
+  unsigned int phase = (frame / 10 + lane) % 20;
+  return phase < 16 ? 1u << phase : 0;
+}
+
+// Prints the first difference between lane and c8, returns false if any
+static bool compare(LaneEngine &lanes, unsigned int lane, Reference &ref,
+                    uint64_t frame) {
+  Display display(LaneEngine::display_width, LaneEngine::display_height);
+  Keyboard keyboard;
+  CHIP8 got(&display, &keyboard);
+  lanes.export_lane(lane, got, display);
+  const CHIP8 &want = ref.c8;
+
+  const char *field = nullptr;
+  if (got.V != want.V)
+    field = "V";
+  else if (got.I != want.I)
+    field = "I";
+  else if (got.PC != want.PC)
+    field = "PC";
+  else if (got.SP != want.SP)
+    field = "SP";
+  else if (got.DT != want.DT || got.ST != want.ST)
+    field = "timers";
+  else if (got.stack != want.stack)
+    field = "stack";
+  else if (got.memory != want.memory)
+    field = "memory";
+  else if (display.get_buffer() != ref.display.get_buffer())
+    field = "display";
+  if (field == nullptr)
+    return true;
+
+  std::cerr << "[ERROR] Lane " << lane << " differs in " << field
+            << " after frame " << frame << " (PC " << std::hex << got.PC
+            << ", reference PC " << want.PC << std::dec << ")" << std::endl;
+  return false;
+}
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr;
+  QuirkProfile quirks = QUIRKS_DEFAULT;
+  bool quirks_given = false;
+  unsigned int lane_count = LaneEngine::max_lanes;
+  uint64_t frames = 600;
+  unsigned int cpu_hz = Scheduler::default_cpu_hz;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+      if (!parse_quirk_profile(argv[++i], quirks)) {
+        std::cerr << "[ERROR] Unknown quirk profile: " << argv[i] << std::endl;
+        return 1;
+      }
+      quirks_given = true;
+    } else if (std::strcmp(argv[i], "--lanes") == 0 && i + 1 < argc) {
+      lane_count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--hz") == 0 && i + 1 < argc) {
+      cpu_hz = std::strtoul(argv[++i], nullptr, 10);
+    } else if (argv[i][0] != '-' && rom == nullptr) {
+      rom = argv[i];
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (rom == nullptr) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (!quirks_given)
+    quirks = quirk_profile_for_rom(rom);
+
+  RomFile file;
+  if (!file.open(rom))
+    return 1;
+
+  LaneEngine lanes(lane_count, quirks);
+  if (!lanes.load_rom(file.data(), file.size()))
+    return 1;
+  std::vector<std::unique_ptr<Reference>> refs;
+  for (unsigned int lane = 0; lane < lanes.get_lanes(); lane++) {
+    refs.push_back(std::make_unique<Reference>());
+    CHIP8 &c8 = refs.back()->c8;
+    c8.set_quirks(quirks);
+    c8.load_rom(file.data(), file.size());
+    c8.seed_random(CHIP8::default_seed + lane);
+    lanes.seed_random(lane, CHIP8::default_seed + lane);
+  }
+
+  // Timer ticks fall where the Scheduler puts them
+  uint64_t cycles = 0;
+  for (uint64_t frame = 1; frame <= frames; frame++) {
+    uint64_t target = frame * cpu_hz / Scheduler::timer_hz;
+    for (unsigned int lane = 0; lane < lanes.get_lanes(); lane++) {
+      uint16_t keys = lane_keys(lane, frame);
+      lanes.set_keys(lane, keys);
+      refs[lane]->keyboard.set_keys(keys);
+      refs[lane]->c8.run(target - cycles);
+      refs[lane]->c8.tick_timers();
+    }
+    lanes.step_all(target - cycles);
+    lanes.tick_timers();
+    cycles = target;
+
+    for (unsigned int lane = 0; lane < lanes.get_lanes(); lane++)
+      if (!compare(lanes, lane, *refs[lane], frame))
+        return 1;
+  }
+
+  std::cout << rom << ": " << lanes.get_lanes() << " lanes match over "
+            << frames << " frames (" << quirk_profile_name(quirks) << ")"
+            << std::endl;
+  return 0;
+}